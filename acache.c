@@ -0,0 +1,257 @@
+#include "acache.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct cache_entry {
+	struct cache_entry *hnext;	// hash chain
+	struct cache_entry *prev;	// lru list, head is the most recent
+	struct cache_entry *next;
+	uint64_t hash;
+	int sz;
+	int chunk_sz;
+	// source and chunk follow
+};
+
+struct aura_loadcache {
+	int limit;
+	int size;
+	int n;
+	int cap;
+	int hit;
+	int miss;
+	int evict;
+	struct cache_entry *head;
+	struct cache_entry *tail;
+	struct cache_entry **bucket;
+};
+
+static uint64_t
+hash_source(const char *s, int sz) {
+	uint64_t h = 0x9e3779b97f4a7c15ULL ^ (uint64_t)sz;
+	while (sz >= 8) {
+		uint64_t v;
+		memcpy(&v, s, 8);
+		h = (h ^ v) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+		s += 8;
+		sz -= 8;
+	}
+	uint64_t v = 0;
+	memcpy(&v, s, sz);
+	h = (h ^ v) * 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 29;
+	return h;
+}
+
+static inline int
+entry_size(int sz, int chunk_sz) {
+	return (int)sizeof(struct cache_entry) + sz + chunk_sz;
+}
+
+static inline const char *
+entry_source(const struct cache_entry *e) {
+	return (const char *)(e + 1);
+}
+
+static inline char *
+entry_chunk(struct cache_entry *e) {
+	return (char *)(e + 1) + e->sz;
+}
+
+struct aura_loadcache *
+auraC_new(int limit) {
+	struct aura_loadcache *c = (struct aura_loadcache *)malloc(sizeof(*c));
+	if (c == NULL)
+		return NULL;
+	memset(c, 0, sizeof(*c));
+	c->limit = limit;
+	c->cap = 64;
+	c->bucket = (struct cache_entry **)calloc(c->cap, sizeof(*c->bucket));
+	if (c->bucket == NULL) {
+		free(c);
+		return NULL;
+	}
+	return c;
+}
+
+void
+auraC_delete(struct aura_loadcache *c) {
+	if (c == NULL)
+		return;
+	struct cache_entry *e = c->head;
+	while (e) {
+		struct cache_entry *next = e->next;
+		free(e);
+		e = next;
+	}
+	free(c->bucket);
+	free(c);
+}
+
+static void
+lru_unlink(struct aura_loadcache *c, struct cache_entry *e) {
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		c->head = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	else
+		c->tail = e->prev;
+}
+
+static void
+lru_pushfront(struct aura_loadcache *c, struct cache_entry *e) {
+	e->prev = NULL;
+	e->next = c->head;
+	if (c->head)
+		c->head->prev = e;
+	else
+		c->tail = e;
+	c->head = e;
+}
+
+static void
+remove_entry(struct aura_loadcache *c, struct cache_entry *e) {
+	struct cache_entry **p = &c->bucket[e->hash & (c->cap - 1)];
+	while (*p != e)
+		p = &(*p)->hnext;
+	*p = e->hnext;
+	lru_unlink(c, e);
+	c->size -= entry_size(e->sz, e->chunk_sz);
+	--c->n;
+	free(e);
+}
+
+static void
+rehash(struct aura_loadcache *c) {
+	int cap = c->cap * 2;
+	struct cache_entry **bucket = (struct cache_entry **)calloc(cap, sizeof(*bucket));
+	if (bucket == NULL)
+		return;	// keep the long chains
+	struct cache_entry *e;
+	for (e = c->head; e; e = e->next) {
+		struct cache_entry **b = &bucket[e->hash & (cap - 1)];
+		e->hnext = *b;
+		*b = e;
+	}
+	free(c->bucket);
+	c->bucket = bucket;
+	c->cap = cap;
+}
+
+// Copy the chunk of source into output, returns its size or -1 if missing
+int
+auraC_get(struct aura_loadcache *c, const char *source, int sz, char *output) {
+	uint64_t h = hash_source(source, sz);
+	struct cache_entry *e = c->bucket[h & (c->cap - 1)];
+	for (; e; e = e->hnext) {
+		if (e->hash == h && e->sz == sz && memcmp(entry_source(e), source, sz) == 0) {
+			++c->hit;
+			if (e != c->head) {
+				lru_unlink(c, e);
+				lru_pushfront(c, e);
+			}
+			memcpy(output, entry_chunk(e), e->chunk_sz);
+			return e->chunk_sz;
+		}
+	}
+	++c->miss;
+	return -1;
+}
+
+void
+auraC_put(struct aura_loadcache *c, const char *source, int sz, const char *chunk, int chunk_sz) {
+	int esz = entry_size(sz, chunk_sz);
+	if (esz > c->limit)
+		return;
+	struct cache_entry *e = (struct cache_entry *)malloc(esz);
+	if (e == NULL)
+		return;
+	e->hash = hash_source(source, sz);
+	e->sz = sz;
+	e->chunk_sz = chunk_sz;
+	memcpy((char *)(e + 1), source, sz);
+	memcpy(entry_chunk(e), chunk, chunk_sz);
+	while (c->size + esz > c->limit) {
+		remove_entry(c, c->tail);
+		++c->evict;
+	}
+	if (c->n >= c->cap)
+		rehash(c);
+	struct cache_entry **b = &c->bucket[e->hash & (c->cap - 1)];
+	e->hnext = *b;
+	*b = e;
+	lru_pushfront(c, e);
+	c->size += esz;
+	++c->n;
+}
+
+void
+auraC_stat(struct aura_loadcache *c, struct aura_cachestat *stat) {
+	stat->hit = c->hit;
+	stat->miss = c->miss;
+	stat->evict = c->evict;
+	stat->n = c->n;
+	stat->size = c->size;
+	stat->limit = c->limit;
+}
+
+#ifdef CACHE_TESTMAIN
+
+#include <stdio.h>
+#include <assert.h>
+
+static void
+put(struct aura_loadcache *c, const char *source) {
+	char chunk[64];
+	int sz = strlen(source);
+	memset(chunk, sz, sizeof(chunk));
+	auraC_put(c, source, sz, chunk, sizeof(chunk));
+}
+
+static int
+get(struct aura_loadcache *c, const char *source) {
+	char chunk[64];
+	int sz = strlen(source);
+	int r = auraC_get(c, source, sz, chunk);
+	if (r < 0)
+		return 0;
+	assert(r == sizeof(chunk) && chunk[0] == sz);
+	return 1;
+}
+
+static void
+dump(struct aura_loadcache *c) {
+	struct aura_cachestat stat;
+	auraC_stat(c, &stat);
+	printf("hit = %d miss = %d evict = %d n = %d size = %d\n", stat.hit, stat.miss, stat.evict, stat.n, stat.size);
+}
+
+int
+main() {
+	// room for 3 entries
+	struct aura_loadcache *c = auraC_new(3 * (sizeof(struct cache_entry) + 64 + 8));
+	put(c, "[1 2 +]");
+	put(c, "[3 4 +]");
+	put(c, "[5 6 +]");
+	assert(get(c, "[1 2 +]"));
+	put(c, "[7 8 +]");	// evicts [3 4 +]
+	assert(!get(c, "[3 4 +]"));
+	assert(get(c, "[1 2 +]"));
+	assert(get(c, "[5 6 +]"));
+	assert(get(c, "[7 8 +]"));
+	assert(!get(c, "[1 2 +] "));
+	int i;
+	char name[32];
+	for (i=0;i<200;i++) {
+		snprintf(name, sizeof(name), "[%d]", i);
+		put(c, name);
+	}
+	dump(c);
+	auraC_delete(c);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef aura_cache_h
+#define aura_cache_h
+
+// Parse cache of aura_load, keyed by a hash of the source bytes
+
+struct aura_loadcache;
+
+struct aura_cachestat {
+	int hit;
+	int miss;
+	int evict;
+	int n;	// entries
+	int size;	// bytes in use
+	int limit;
+};
+
+struct aura_loadcache * auraC_new(int limit);
+void auraC_delete(struct aura_loadcache *c);
+int auraC_get(struct aura_loadcache *c, const char *source, int sz, char *output);
+void auraC_put(struct aura_loadcache *c, const char *source, int sz, const char *chunk, int chunk_sz);
+void auraC_stat(struct aura_loadcache *c, struct aura_cachestat *stat);
+
+#endif
@@ -0,0 +1,239 @@
+#include "aevent.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#define MAXOP 1024
+#define MAXEVENT 64
+
+#define OP_READABLE 0
+#define OP_EVENTREAD 1
+#define OP_SLEEP 2
+
+struct event_op {
+	int fd;
+	int kind;
+	int token;
+	int next;
+};
+
+struct aura_event {
+	struct aura_context *ctx;
+	int epfd;
+	int freelist;
+	struct event_op op[MAXOP];
+};
+
+static int
+add_op(struct aura_event *e, int fd, int kind, int token) {
+	int index = e->freelist;
+	if (index < 0)
+		return -ENOMEM;
+	struct epoll_event ev;
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.u32 = index;
+	if (epoll_ctl(e->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		return -errno;
+	struct event_op *op = &e->op[index];
+	e->freelist = op->next;
+	op->fd = fd;
+	op->kind = kind;
+	op->token = token;
+	return 0;
+}
+
+static void
+start_op(struct aura_context *ctx, struct aura_event *e, int fd, int kind, int token) {
+	int err = add_op(e, fd, kind, token);
+	if (err < 0) {
+		if (kind == OP_SLEEP)
+			close(fd);
+		aura_complete(ctx, token, err);
+	}
+}
+
+// fd readable : wait until fd is readable
+static void
+async_readable(struct aura_context *ctx, int token, int fd, void *ud) {
+	start_op(ctx, (struct aura_event *)ud, fd, OP_READABLE, token);
+}
+
+// fd eventread : wait an eventfd and read its counter
+static void
+async_eventread(struct aura_context *ctx, int token, int fd, void *ud) {
+	start_op(ctx, (struct aura_event *)ud, fd, OP_EVENTREAD, token);
+}
+
+// ms sleep
+static void
+async_sleep(struct aura_context *ctx, int token, int ms, void *ud) {
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0) {
+		aura_complete(ctx, token, -errno);
+		return;
+	}
+	struct itimerspec t;
+	memset(&t, 0, sizeof(t));
+	if (ms <= 0)
+		ms = 1;
+	t.it_value.tv_sec = ms / 1000;
+	t.it_value.tv_nsec = (ms % 1000) * 1000000;
+	if (timerfd_settime(fd, 0, &t, NULL) < 0) {
+		int err = -errno;
+		close(fd);
+		aura_complete(ctx, token, err);
+		return;
+	}
+	start_op(ctx, (struct aura_event *)ud, fd, OP_SLEEP, token);
+}
+
+struct aura_event *
+auraE_new(struct aura_context *ctx) {
+	struct aura_event *e = (struct aura_event *)malloc(sizeof(*e));
+	if (e == NULL)
+		return NULL;
+	e->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (e->epfd < 0) {
+		free(e);
+		return NULL;
+	}
+	e->ctx = ctx;
+	int i;
+	for (i=0;i<MAXOP;i++) {
+		e->op[i].fd = -1;
+		e->op[i].next = i + 1;
+	}
+	e->op[MAXOP-1].next = -1;
+	e->freelist = 0;
+	aura_registerasync(ctx, "readable", async_readable, e);
+	aura_registerasync(ctx, "eventread", async_eventread, e);
+	aura_registerasync(ctx, "sleep", async_sleep, e);
+	return e;
+}
+
+void
+auraE_delete(struct aura_event *e) {
+	if (e == NULL)
+		return;
+	int i;
+	for (i=0;i<MAXOP;i++) {
+		if (e->op[i].fd >= 0 && e->op[i].kind == OP_SLEEP)
+			close(e->op[i].fd);
+	}
+	close(e->epfd);
+	free(e);
+}
+
+static int
+finish_op(struct event_op *op) {
+	uint64_t v;
+	ssize_t n;
+	switch (op->kind) {
+	case OP_EVENTREAD:
+	case OP_SLEEP:
+		n = read(op->fd, &v, sizeof(v));
+		if (n < 0)
+			return -errno;
+		return (int)v;
+	default:
+		return 1;
+	}
+}
+
+/*
+	Wait at most timeout ms (-1 forever), complete the ready async functions,
+	and write their tokens for the host to resume. Returns the number of tokens, or -1.
+ */
+int
+auraE_dispatch(struct aura_event *e, int timeout, int *tokens, int n) {
+	struct epoll_event ev[MAXEVENT];
+	if (n > MAXEVENT)
+		n = MAXEVENT;
+	int r = epoll_wait(e->epfd, ev, n, timeout);
+	if (r < 0)
+		return errno == EINTR ? 0 : -1;
+	int i;
+	for (i=0;i<r;i++) {
+		int index = ev[i].data.u32;
+		struct event_op *op = &e->op[index];
+		int result = finish_op(op);
+		epoll_ctl(e->epfd, EPOLL_CTL_DEL, op->fd, NULL);
+		if (op->kind == OP_SLEEP)
+			close(op->fd);
+		op->fd = -1;
+		op->next = e->freelist;
+		e->freelist = index;
+		tokens[i] = op->token;
+		aura_complete(e->ctx, op->token, result);
+	}
+	return r;
+}
+
+#ifdef EVENT_TESTMAIN
+
+#include <stdio.h>
+#include <assert.h>
+#include <sys/eventfd.h>
+
+static void
+errorhook(void *ud, const char *msg) {
+	printf("Error: %s\n", msg);
+	assert(0);
+}
+
+// completes synchronously
+static void
+report(struct aura_context *ctx, int token, int arg, void *ud) {
+	printf("report %d\n", arg);
+	aura_complete(ctx, token, arg);
+}
+
+int
+main() {
+	struct aura_context *ctx = aura_newstate(NULL, errorhook);
+	struct aura_event *e = auraE_new(ctx);
+	aura_registerasync(ctx, "report", report, NULL);
+
+	// loopback stand-in for a device, the host writes what the script reads
+	int loopback = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	char source[256];
+	int sz = snprintf(source, sizeof(source),
+		"[ %d eventread report (x) ] 'reader def "
+		"[ 20 sleep report (x) ] 'sleeper def ", loopback);
+	static char output[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source, sz, output);
+	aura_run(ctx, 0, output);
+
+	int reader = aura_newcoroutine(ctx, "reader");
+	int sleeper = aura_newcoroutine(ctx, "sleeper");
+	int r = aura_stepcoroutine(ctx, reader, 0);
+	assert(r == AURA_SUSPEND);
+	r = aura_stepcoroutine(ctx, sleeper, 0);
+	assert(r == AURA_SUSPEND);
+
+	uint64_t v = 42;
+	r = write(loopback, &v, sizeof(v));
+	assert(r == sizeof(v));
+
+	int running = 2;
+	while (running > 0) {
+		int tokens[16];
+		int n = auraE_dispatch(e, -1, tokens, 16);
+		int i;
+		for (i=0;i<n;i++) {
+			if (aura_stepcoroutine(ctx, tokens[i], 0) == AURA_OK)
+				--running;
+		}
+	}
+
+	close(loopback);
+	auraE_delete(e);
+	aura_close(ctx);
+	return 0;
+}
+
+#endif
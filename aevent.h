@@ -0,0 +1,14 @@
+#ifndef aura_event_h
+#define aura_event_h
+
+#include "aura.h"
+
+// Reference epoll integration (linux) of async functions
+
+struct aura_event;
+
+struct aura_event * auraE_new(struct aura_context *ctx);
+void auraE_delete(struct aura_event *e);
+int auraE_dispatch(struct aura_event *e, int timeout, int *tokens, int n);
+
+#endif
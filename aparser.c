@@ -3,6 +3,7 @@
 #include <string.h>
 #include "aparser.h"
 #include "aura.h"
+#include "atype.h"
 
 #define MAXSIZE 0x10000
 #define MAXATOM 8192
@@ -59,6 +60,15 @@ parse_tuple(struct parser_context *ctx) {
 	return ps - ctx->buffer + 1;
 }
 
+// "string" has no escape, the atom keeps the quotes
+static inline int
+parse_string(struct parser_context *ctx) {
+	const char *ps = memchr(ctx->buffer+1, '"', ctx->sz-1);
+	if (ps == NULL)
+		return PARSER_ERR_STRING;
+	return ps - ctx->buffer + 1;
+}
+
 static inline int
 parse_atom(struct parser_context *ctx) {
 	int n = ctx->sz - 1;
@@ -89,6 +99,8 @@ parse_token(struct parser_context *ctx) {
 		return 1;
 	case '(' :
 		return parse_tuple(ctx);
+	case '"' :
+		return parse_string(ctx);
 	default:
 		return parse_atom(ctx);
 	}
@@ -232,7 +244,7 @@ convert_node(struct convert_context *ctx) {
 					break;
 				// FALLTHROUGH
 			default:
-				node->index.type = AURA_TWORD;
+				node->index.type = AURA_TATOM;
 				ctx->output->atom.len = ctx->atom->size;
 				ctx->output->atom.offset = ctx->atom->offset;
 				break;
@@ -275,7 +287,8 @@ auraP_parse(const char * source, int sz, union list_node *node, int node_sz) {
 	int err = parse_list(&ctx);
 	if (err)
 		return err;
-	int need_sz = ctx.atom_n * 2 + 1;
+	// root index and root list, then an index and a data node for each atom (or list)
+	int need_sz = ctx.atom_n * 2 + 2;
 	if (need_sz > node_sz)
 		return need_sz;
 	convert(&ctx, node);
@@ -297,10 +310,11 @@ dump_node(union list_node *node, int index, int indent, const char *source) {
 			dump_node(node, data->list.offset+i, indent + 1, source);
 		}
 		break;
+	case AURA_TATOM:
+		printf("ATOM [%.*s]\n", data->atom.len, source + data->atom.offset);
+		break;
 	case AURA_TWORD:
 		printf("WORD [%d]\n", data->word);
-//		printf("WORD [%.*s]\n", data->atom.len, source + data->atom.offset);
-//		break;
 		break;
 	case AURA_TWORDREF:
 		printf("WORDREF [%d]\n", data->word);
@@ -344,6 +358,10 @@ main() {
 	int n = test(source, node);
 	printf("n = %d\n", n);
 	auraP_dump(node, source);
+	const char strings[] = "c \"a [string]\" [\"\"]";
+	n = test(strings, node);
+	printf("n = %d\n", n);
+	auraP_dump(node, strings);
 	return 0;
 }
 
@@ -8,6 +8,7 @@
 #define PARSER_ERR_MAXNODE -3
 #define PARSER_ERR_MAXATOM -4
 #define PARSER_ERR_LIST -5
+#define PARSER_ERR_STRING -6
 
 union list_node {
 	struct {
@@ -0,0 +1,172 @@
+#include "apool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct aura_pool {
+	int n;
+	int quit;
+	unsigned job;	// bumped for each run
+	int ntask;
+	int next;	// next task to take
+	int busy;	// pool threads still in the job
+	aura_taskfunction f;
+	void *ud;
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	pthread_t thread[1];
+};
+
+struct worker_arg {
+	struct aura_pool *p;
+	int id;
+};
+
+// Take tasks until there is none left, with the lock held
+static void
+take_tasks(struct aura_pool *p, int worker) {
+	while (p->next < p->ntask) {
+		int task = p->next++;
+		pthread_mutex_unlock(&p->lock);
+		p->f(p->ud, worker, task);
+		pthread_mutex_lock(&p->lock);
+	}
+}
+
+static void *
+worker_main(void *ud) {
+	struct worker_arg *arg = (struct worker_arg *)ud;
+	struct aura_pool *p = arg->p;
+	int id = arg->id;
+	free(arg);
+	unsigned job = 0;	// a job may start before the thread runs
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		while (p->job == job && !p->quit)
+			pthread_cond_wait(&p->start, &p->lock);
+		if (p->quit)
+			break;
+		job = p->job;
+		take_tasks(p, id);
+		if (--p->busy == 0)
+			pthread_cond_signal(&p->done);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+struct aura_pool *
+auraT_new(int n) {
+	if (n < 0)
+		n = 0;
+	struct aura_pool *p = (struct aura_pool *)malloc(sizeof(*p) + n * sizeof(pthread_t));
+	if (p == NULL)
+		return NULL;
+	p->n = 0;
+	p->quit = 0;
+	p->job = 0;
+	p->ntask = 0;
+	p->next = 0;
+	p->busy = 0;
+	p->f = NULL;
+	p->ud = NULL;
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->start, NULL);
+	pthread_cond_init(&p->done, NULL);
+	int i;
+	for (i=0;i<n;i++) {
+		struct worker_arg *arg = (struct worker_arg *)malloc(sizeof(*arg));
+		if (arg == NULL)
+			break;
+		arg->p = p;
+		arg->id = i + 1;
+		if (pthread_create(&p->thread[i], NULL, worker_main, arg) != 0) {
+			free(arg);
+			break;
+		}
+		++p->n;
+	}
+	return p;
+}
+
+void
+auraT_delete(struct aura_pool *p) {
+	if (p == NULL)
+		return;
+	pthread_mutex_lock(&p->lock);
+	p->quit = 1;
+	pthread_cond_broadcast(&p->start);
+	pthread_mutex_unlock(&p->lock);
+	int i;
+	for (i=0;i<p->n;i++) {
+		pthread_join(p->thread[i], NULL);
+	}
+	pthread_cond_destroy(&p->done);
+	pthread_cond_destroy(&p->start);
+	pthread_mutex_destroy(&p->lock);
+	free(p);
+}
+
+int
+auraT_workers(struct aura_pool *p) {
+	return p->n;
+}
+
+void
+auraT_run(struct aura_pool *p, int ntask, aura_taskfunction f, void *ud) {
+	pthread_mutex_lock(&p->lock);
+	p->f = f;
+	p->ud = ud;
+	p->ntask = ntask;
+	p->next = 0;
+	p->busy = p->n;
+	++p->job;
+	pthread_cond_broadcast(&p->start);
+	take_tasks(p, 0);
+	while (p->busy > 0)
+		pthread_cond_wait(&p->done, &p->lock);
+	pthread_mutex_unlock(&p->lock);
+}
+
+int
+auraT_cpus(void) {
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+}
+
+#ifdef POOL_TESTMAIN
+
+#include <stdio.h>
+#include <assert.h>
+
+static long result[1000];
+
+static void
+square(void *ud, int worker, int task) {
+	int *count = (int *)ud;
+	result[task] = (long)task * task;
+	__atomic_fetch_add(&count[worker], 1, __ATOMIC_RELAXED);
+}
+
+int
+main() {
+	struct aura_pool *p = auraT_new(3);
+	int count[4] = { 0 };
+	int i, j;
+	for (j=0;j<10;j++) {
+		auraT_run(p, 1000, square, count);
+		long sum = 0;
+		for (i=0;i<1000;i++)
+			sum += result[i];
+		assert(sum == 332833500);
+	}
+	auraT_run(p, 0, square, count);
+	int total = count[0] + count[1] + count[2] + count[3];
+	assert(total == 10000);
+	printf("pool %d workers, %d cpus, tasks %d %d %d %d\n", auraT_workers(p), auraT_cpus(), count[0], count[1], count[2], count[3]);
+	auraT_delete(p);
+	return 0;
+}
+
+#endif
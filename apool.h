@@ -0,0 +1,18 @@
+#ifndef aura_pool_h
+#define aura_pool_h
+
+// A fixed pool of worker threads running the tasks of one job at a time
+
+struct aura_pool;
+
+// worker is 0 for the calling thread, 1 .. n for the pool threads
+typedef void (*aura_taskfunction)(void *ud, int worker, int task);
+
+struct aura_pool * auraT_new(int n);
+void auraT_delete(struct aura_pool *p);
+int auraT_workers(struct aura_pool *p);
+// Run tasks 0 .. ntask-1, the calling thread joins the workers and returns when all are done
+void auraT_run(struct aura_pool *p, int ntask, aura_taskfunction f, void *ud);
+int auraT_cpus(void);
+
+#endif
@@ -9,37 +9,48 @@ auraS_createlist(struct aura_stack *s, int sz) {
 		return 0;
 	if (!auraS_checkstack(s, 1))
 		return 0;
-	uint8_t *list = &s->list_t[s->list_n];
+	union aura_var v;
+	v.d = 0;
 	int i;
 	for (i=0;i<sz;i++) {
-		list[i] = AURA_TFALSE;
+		AURA_SLOTSET(s->list_t, s->list, s->list_n + i, AURA_TFALSE, v);
 	}
-	s->type[s->top] = AURA_TDLIST;
-	union aura_var *v =&s->v[s->top];
-	v->dlist.offset = s->list_n;
-	v->dlist.size = (uint16_t)sz;
+	v.dlist.offset = s->list_n;
+	v.dlist.size = (uint32_t)sz;
+	AURA_SLOTSET(s->type, s->v, s->top, AURA_TDLIST, v);
 	s->list_n += sz;
 	s->top++;
 
 	return 1;
 }
 
+// slots of the block of a list, a dict or a sequence in the heap
+static inline int
+block_size_(int t, union aura_var v) {
+	return t == AURA_TDICT ? 2 + 2 * v.dlist.size : (int)v.dlist.size;
+}
+
 static int
-deepcopy_list(struct aura_stack *s, union aura_var *var, int map[AURA_LISTSIZE]) {
-	if (s->top + var->dlist.size > HEAPSIZE(s))
+deepcopy_list(struct aura_stack *s, int type, union aura_var *var, int map[AURA_LISTSIZE]) {
+	int sz = block_size_(type, *var);
+	if (s->list_n + sz > HEAPSIZE(s))
 		return 0;
-	s->list_heap += var->dlist.size;
+	s->list_heap += sz;
 	int i;
 	int heap =  HEAPSIZE(s);
 	map[var->dlist.offset] = heap;
-	for (i = 0; i < var->dlist.size; i++) {
-		int t = s->list_t[heap+i] = s->list_t[var->dlist.offset+i];
-		union aura_var tmp = s->list[var->dlist.offset+i];
-		if (t == AURA_TDLIST && map[tmp.dlist.offset] < 0) {
-			if (!deepcopy_list(s, &tmp, map))
-				return 0;
+	for (i = 0; i < sz; i++) {
+		union aura_var tmp;
+		int t = AURA_SLOTGET(s->list_t, s->list, var->dlist.offset+i, &tmp);
+		if (t == AURA_TDLIST || t == AURA_TDICT || t == AURA_TSEQ) {
+			if (map[tmp.dlist.offset] < 0) {
+				if (!deepcopy_list(s, t, &tmp, map))
+					return 0;
+			} else {
+				tmp.dlist.offset = map[tmp.dlist.offset];
+			}
 		}
-		s->list[heap+i] = tmp;
+		AURA_SLOTSET(s->list_t, s->list, heap+i, t, tmp);
 	}
 	var->dlist.offset = heap;
 	return 1;
@@ -47,8 +58,10 @@ deepcopy_list(struct aura_stack *s, union aura_var *var, int map[AURA_LISTSIZE])
 
 int
 auraS_persistence(struct aura_stack *s) {
-	assert(s->top > 0 && s->type[s->top-1] == AURA_TDLIST);
-	union aura_var var = s->v[s->top-1];
+	assert(s->top > 0);
+	union aura_var var;
+	int t = auraS_get(s, -1, &var);
+	assert(t == AURA_TDLIST || t == AURA_TDICT || t == AURA_TSEQ);
 	int heap = s->list_heap;
 	int listmap[AURA_LISTSIZE];
 	int i;
@@ -60,8 +73,8 @@ auraS_persistence(struct aura_stack *s) {
 	for (i= HEAPSIZE(s); i<AURA_LISTSIZE; i++) {
 		listmap[i] = i;	// already persistence
 	}
-	if (deepcopy_list(s, &var, listmap)) {
-		s->v[s->top-1] = var;
+	if (deepcopy_list(s, t, &var, listmap)) {
+		AURA_SLOTSET(s->type, s->v, s->top-1, t, var);
 		return 1;
 	} else {
 		s->list_heap = heap;	// failed, restore heap
@@ -69,18 +82,31 @@ auraS_persistence(struct aura_stack *s) {
 	}
 }
 
+// Copy the persistent heap and the first n slots of the temporary heap into another stack
+void
+auraS_copyheap(struct aura_stack *to, const struct aura_stack *from, int n) {
+	int i;
+	for (i=0;i<n;i++) {
+		AURA_SLOTCOPY(to->list_t, to->list, i, from->list_t, from->list, i);
+	}
+	for (i=HEAPSIZE(from);i<AURA_LISTSIZE;i++) {
+		AURA_SLOTCOPY(to->list_t, to->list, i, from->list_t, from->list, i);
+	}
+	to->list_n = n;
+	to->list_heap = from->list_heap;
+}
+
 void
 auraS_setn(struct aura_stack *s, int index, int n) {
 	index = auraS_absindex(s, index);
 	assert(auraS_checkstackid(s, index));
-	assert(s->type[index-1] == AURA_TDLIST);
-	union aura_var *v = &s->v[index-1];
-	assert(n >= 0 && n < v->dlist.size);
-	union aura_var *list = &s->list[v->dlist.offset];
-	uint8_t *list_type = &s->list_t[v->dlist.offset];
+	union aura_var v;
+	int t = auraS_get(s, index, &v);
+	assert(t == AURA_TDLIST);
+	(void)t;
+	assert(n >= 0 && n < v.dlist.size);
 	int top = --s->top;
-	list_type[n] = s->type[top];
-	list[n] = s->v[top];
+	AURA_SLOTCOPY(s->list_t, s->list, v.dlist.offset + n, s->type, s->v, top);
 }
 
 void
@@ -88,18 +114,332 @@ auraS_getn(struct aura_stack *s, int index, int n) {
 	assert(auraS_checkstack(s, 1));
 	index = auraS_absindex(s, index);
 	assert(auraS_checkstackid(s, index));
-	assert(s->type[index-1] == AURA_TDLIST);
-	assert(s->type[index-1] == AURA_TDLIST);
-	union aura_var *v = &s->v[index-1];
-	assert(n >= 0 && n < v->dlist.size);
-	union aura_var *list = &s->list[v->dlist.offset];
-	uint8_t *list_type = &s->list_t[v->dlist.offset];
+	union aura_var v;
+	int t = auraS_get(s, index, &v);
+	assert(t == AURA_TDLIST);
+	(void)t;
+	assert(n >= 0 && n < v.dlist.size);
 
 	int top = s->top++;
-	s->type[top] = list_type[n];
-	s->v[top] = list[n];
+	AURA_SLOTCOPY(s->type, s->v, top, s->list_t, s->list, v.dlist.offset + n);
+}
+
+/*
+	A growable list is a block of the temporary heap led by an AURA_TLISTCAP slot :
+	dlist.offset is the size in use and dlist.size is the capacity.
+	A list value (a view of the block) is appended in place only if it covers all the used elements,
+	so the other views never see the new elements.
+	The unused slots are cleared, so a list allocated after the block never finds a stale header of an earlier run.
+ */
+static int
+growable_(struct aura_stack *s, union aura_var list, union aura_var *header) {
+	if (list.dlist.offset == 0 || list.dlist.offset >= s->list_n)
+		return 0;
+	if (AURA_SLOTGET(s->list_t, s->list, list.dlist.offset - 1, header) != AURA_TLISTCAP)
+		return 0;
+	if (list.dlist.offset + header->dlist.size > s->list_n)
+		return 0;
+	return header->dlist.offset == list.dlist.size;
+}
+
+static void
+clearslots_(struct aura_stack *s, int from, int to) {
+	union aura_var v;
+	v.d = 0;
+	int i;
+	for (i=from;i<to;i++) {
+		AURA_SLOTSET(s->list_t, s->list, i, AURA_TFALSE, v);
+	}
+}
+
+// list value -> list, the value is appended. Returns 0 if the heap is full
+int
+auraS_append(struct aura_stack *s) {
+	assert(s->top >= 2 && auraS_type(s, -2) == AURA_TDLIST);
+	union aura_var list, header;
+	auraS_get(s, -2, &list);
+	int n = list.dlist.size;
+	int top = s->top - 1;
+	if (growable_(s, list, &header)) {
+		int cap = header.dlist.size;
+		if (n == cap && list.dlist.offset + cap == s->list_n && s->list_n + cap <= HEAPSIZE(s)) {
+			// the block is on the top of the heap, double it in place
+			clearslots_(s, s->list_n, s->list_n + cap);
+			s->list_n += cap;
+			cap *= 2;
+		}
+		if (n < cap) {
+			AURA_SLOTCOPY(s->list_t, s->list, list.dlist.offset + n, s->type, s->v, top);
+			header.dlist.offset = n + 1;
+			header.dlist.size = cap;
+			AURA_SLOTSET(s->list_t, s->list, list.dlist.offset - 1, AURA_TLISTCAP, header);
+			list.dlist.size = n + 1;
+			AURA_SLOTSET(s->type, s->v, top - 1, AURA_TDLIST, list);
+			s->top = top;
+			return 1;
+		}
+	}
+	// move into a new block with room to grow
+	int cap = n < 4 ? 8 : n * 2;
+	if (s->list_n + 1 + cap > HEAPSIZE(s)) {
+		cap = n + 1;
+		if (s->list_n + 1 + cap > HEAPSIZE(s))
+			return 0;
+	}
+	int offset = s->list_n + 1;
+	int i;
+	for (i=0;i<n;i++) {
+		AURA_SLOTCOPY(s->list_t, s->list, offset + i, s->list_t, s->list, list.dlist.offset + i);
+	}
+	AURA_SLOTCOPY(s->list_t, s->list, offset + n, s->type, s->v, top);
+	clearslots_(s, offset + n + 1, offset + cap);
+	header.dlist.offset = n + 1;
+	header.dlist.size = cap;
+	AURA_SLOTSET(s->list_t, s->list, offset - 1, AURA_TLISTCAP, header);
+	s->list_n = offset + cap;
+	list.dlist.offset = offset;
+	list.dlist.size = n + 1;
+	AURA_SLOTSET(s->type, s->v, top - 1, AURA_TDLIST, list);
+	s->top = top;
+	return 1;
+}
+
+/*
+	A dict is an open addressing table in the list heap, its value is (offset, capacity).
+	The block starts with the number of keys and the number of used slots (keys and tombstones),
+	then capacity pairs of key and value. The keys are integers, wordrefs or strings (by content).
+ */
+
+#define DICT_EMPTY AURA_TFALSE
+#define DICT_DELETED AURA_TTRUE
+#define DICT_KEY(d, i) ((d).dlist.offset + 2 + (i) * 2)
+
+static inline uint32_t
+dict_hash_(struct aura_stack *s, int t, union aura_var k) {
+	if (t == AURA_TSTRING)
+		return auraS_hashstring(auraS_string(s, k), k.str.size);
+	uint32_t h = ((uint32_t)k.d ^ ((uint32_t)t << 24)) * 2654435761u;
+	return h ^ (h >> 16);
+}
+
+static inline int
+dict_header_(struct aura_stack *s, union aura_var dict, int i) {
+	union aura_var v;
+	int t = AURA_SLOTGET(s->list_t, s->list, dict.dlist.offset + i, &v);
+	assert(t == AURA_TINT);
+	(void)t;
+	return v.d;
+}
+
+static inline void
+dict_setheader_(struct aura_stack *s, union aura_var dict, int n, int used) {
+	union aura_var v;
+	v.d = n;
+	AURA_SLOTSET(s->list_t, s->list, dict.dlist.offset, AURA_TINT, v);
+	v.d = used;
+	AURA_SLOTSET(s->list_t, s->list, dict.dlist.offset + 1, AURA_TINT, v);
+}
+
+// Returns 1 if the key is found, slot is the key or the slot to insert it
+static int
+dict_find_(struct aura_stack *s, union aura_var dict, int t, union aura_var k, int *slot) {
+	int mask = dict.dlist.size - 1;
+	int i = dict_hash_(s, t, k) & mask;
+	int insert = -1;
+	for (;;) {
+		union aura_var key;
+		int kt = AURA_SLOTGET(s->list_t, s->list, DICT_KEY(dict, i), &key);
+		if (kt == DICT_EMPTY) {
+			*slot = insert >= 0 ? insert : i;
+			return 0;
+		}
+		if (kt == DICT_DELETED) {
+			if (insert < 0)
+				insert = i;
+		} else if (kt == t && (t == AURA_TSTRING ? auraS_samestring(s, key, k) : key.d == k.d)) {
+			*slot = i;
+			return 1;
+		}
+		i = (i + 1) & mask;
+	}
+}
+
+static int
+dict_alloc_(struct aura_stack *s, int cap, union aura_var *dict) {
+	int sz = 2 + cap * 2;
+	if (s->list_n + sz > HEAPSIZE(s))
+		return 0;
+	union aura_var v;
+	v.d = 0;
+	int i;
+	for (i=0;i<sz;i++) {
+		AURA_SLOTSET(s->list_t, s->list, s->list_n + i, DICT_EMPTY, v);
+	}
+	dict->dlist.offset = s->list_n;
+	dict->dlist.size = cap;
+	s->list_n += sz;
+	dict_setheader_(s, *dict, 0, 0);
+	return 1;
+}
+
+// Move the keys into a new block, drops the tombstones
+static int
+dict_rehash_(struct aura_stack *s, union aura_var *dict, int cap) {
+	union aura_var old = *dict;
+	if (!dict_alloc_(s, cap, dict))
+		return 0;
+	int i;
+	int n = 0;
+	for (i=0;i<old.dlist.size;i++) {
+		union aura_var key;
+		int kt = AURA_SLOTGET(s->list_t, s->list, DICT_KEY(old, i), &key);
+		if (kt != DICT_EMPTY && kt != DICT_DELETED) {
+			int slot;
+			dict_find_(s, *dict, kt, key, &slot);
+			AURA_SLOTCOPY(s->list_t, s->list, DICT_KEY(*dict, slot), s->list_t, s->list, DICT_KEY(old, i));
+			AURA_SLOTCOPY(s->list_t, s->list, DICT_KEY(*dict, slot) + 1, s->list_t, s->list, DICT_KEY(old, i) + 1);
+			++n;
+		}
+	}
+	dict_setheader_(s, *dict, n, n);
+	return 1;
+}
+
+// Push an empty dict for n keys, returns 0 if the heap is full
+int
+auraS_createdict(struct aura_stack *s, int n) {
+	if (!auraS_checkstack(s, 1))
+		return 0;
+	int cap = 8;
+	while (cap * 3 < n * 4)
+		cap *= 2;
+	union aura_var dict;
+	if (!dict_alloc_(s, cap, &dict))
+		return 0;
+	auraS_pushvar(s, AURA_TDICT, dict);
+	return 1;
+}
+
+static inline union aura_var
+dict_get_(struct aura_stack *s, int index) {
+	union aura_var dict;
+	int t = auraS_get(s, index, &dict);
+	assert(t == AURA_TDICT);
+	(void)t;
+	return dict;
+}
+
+// Pop the key, push its value and returns 1 if the key exists
+int
+auraS_dictget(struct aura_stack *s, int index) {
+	union aura_var dict = dict_get_(s, index);
+	union aura_var k;
+	int t = auraS_get(s, -1, &k);
+	int slot;
+	--s->top;
+	if (!dict_find_(s, dict, t, k, &slot))
+		return 0;
+	AURA_SLOTCOPY(s->type, s->v, s->top, s->list_t, s->list, DICT_KEY(dict, slot) + 1);
+	++s->top;
+	return 1;
+}
+
+// A dict in the persistent heap is never written, the dict at index is replaced by a copy in the temporary heap
+static int
+dict_writable_(struct aura_stack *s, int index, union aura_var *dict) {
+	if (dict->dlist.offset < HEAPSIZE(s))
+		return 1;
+	if (!dict_rehash_(s, dict, dict->dlist.size))
+		return 0;
+	AURA_SLOTSET(s->type, s->v, index-1, AURA_TDICT, *dict);
+	return 1;
+}
+
+/*
+	Pop the key and the value. The dict at index is updated when the table grows or when it is persistent,
+	the table is not shared any more by the other references then.
+	Returns 0 if the heap is full.
+ */
+int
+auraS_dictset(struct aura_stack *s, int index) {
+	index = auraS_absindex(s, index);
+	union aura_var dict = dict_get_(s, index);
+	if (!dict_writable_(s, index, &dict))
+		return 0;
+	union aura_var k;
+	int t = auraS_get(s, -2, &k);
+	int slot;
+	if (!dict_find_(s, dict, t, k, &slot)) {
+		int n = dict_header_(s, dict, 0);
+		int used = dict_header_(s, dict, 1);
+		if ((used + 1) * 4 > dict.dlist.size * 3) {
+			int cap = dict.dlist.size;
+			if ((n + 1) * 2 > cap)
+				cap *= 2;
+			if (!dict_rehash_(s, &dict, cap))
+				return 0;
+			AURA_SLOTSET(s->type, s->v, index-1, AURA_TDICT, dict);
+			n = used = dict_header_(s, dict, 0);
+			dict_find_(s, dict, t, k, &slot);
+		}
+		if (AURA_SLOTTYPE(s->list_t, s->list, DICT_KEY(dict, slot)) == DICT_EMPTY)
+			++used;
+		dict_setheader_(s, dict, n + 1, used);
+		AURA_SLOTCOPY(s->list_t, s->list, DICT_KEY(dict, slot), s->type, s->v, s->top - 2);
+	}
+	AURA_SLOTCOPY(s->list_t, s->list, DICT_KEY(dict, slot) + 1, s->type, s->v, s->top - 1);
+	s->top -= 2;
+	return 1;
+}
+
+// Pop the key, returns 1 if it was removed, or -1 if the heap is full
+int
+auraS_dictdel(struct aura_stack *s, int index) {
+	index = auraS_absindex(s, index);
+	union aura_var dict = dict_get_(s, index);
+	union aura_var k;
+	int t = auraS_get(s, -1, &k);
+	int slot;
+	if (!dict_find_(s, dict, t, k, &slot)) {
+		--s->top;
+		return 0;
+	}
+	if (!dict_writable_(s, index, &dict))
+		return -1;
+	--s->top;
+	dict_find_(s, dict, t, k, &slot);
+	union aura_var v;
+	v.d = 0;
+	AURA_SLOTSET(s->list_t, s->list, DICT_KEY(dict, slot), DICT_DELETED, v);
+	AURA_SLOTSET(s->list_t, s->list, DICT_KEY(dict, slot) + 1, AURA_TFALSE, v);
+	dict_setheader_(s, dict, dict_header_(s, dict, 0) - 1, dict_header_(s, dict, 1));
+	return 1;
+}
+
+int
+auraS_dictlen(struct aura_stack *s, int index) {
+	return dict_header_(s, dict_get_(s, index), 0);
 }
 
+/*
+	Iteration, starts with iter = 0 : push the key and the value of the next slot
+	and returns the next iter, or returns 0 at the end.
+ */
+int
+auraS_dictnext(struct aura_stack *s, int index, int iter) {
+	union aura_var dict = dict_get_(s, index);
+	for (; iter < dict.dlist.size; iter++) {
+		int kt = AURA_SLOTTYPE(s->list_t, s->list, DICT_KEY(dict, iter));
+		if (kt != DICT_EMPTY && kt != DICT_DELETED) {
+			assert(auraS_checkstack(s, 2));
+			AURA_SLOTCOPY(s->type, s->v, s->top, s->list_t, s->list, DICT_KEY(dict, iter));
+			AURA_SLOTCOPY(s->type, s->v, s->top + 1, s->list_t, s->list, DICT_KEY(dict, iter) + 1);
+			s->top += 2;
+			return iter + 1;
+		}
+	}
+	return 0;
+}
 
 #ifdef STACK_TESTMAIN
 
@@ -143,8 +483,10 @@ dumplist(struct aura_stack *s, int index) {
 
 int
 main() {
-	struct aura_stack s;
+	static struct aura_stack s;
+	static uint64_t buffer[(AURA_STACKSIZE * AURA_SLOTSIZE + 7) / 8];
 	memset(&s, 0, sizeof(s));
+	auraS_init(&s, buffer, AURA_STACKSIZE);
 	int ok = auraS_createlist(&s, 8);
 	assert(ok);
 	int i;
@@ -153,6 +495,52 @@ main() {
 		auraS_setn(&s, 1, i);
 	}
 	dumplist(&s, 1);
+	// appending n values moves the list O(log n) times
+	auraS_settop(&s, 0);
+	ok = auraS_createlist(&s, 0);
+	assert(ok);
+	for (i=0;i<1000;i++) {
+		auraS_pushint(&s, i);
+		ok = auraS_append(&s);
+		assert(ok);
+	}
+	union aura_var v;
+	auraS_get(&s, 1, &v);
+	assert(v.dlist.size == 1000);
+	auraS_getn(&s, 1, 999);
+	auraS_get(&s, -1, &v);
+	assert(v.d == 999);
+	printf("append 1000, heap = %d\n", s.list_n);
+
+	auraS_settop(&s, 0);
+	ok = auraS_createdict(&s, 0);
+	assert(ok);
+	for (i=0;i<100;i++) {
+		auraS_pushint(&s, i * 7);
+		auraS_pushint(&s, i);
+		ok = auraS_dictset(&s, 1);
+		assert(ok);
+	}
+	for (i=0;i<100;i+=2) {
+		auraS_pushint(&s, i * 7);
+		ok = auraS_dictdel(&s, 1);
+		assert(ok);
+	}
+	auraS_pushint(&s, 21);
+	ok = auraS_dictget(&s, 1);
+	assert(ok);
+	auraS_get(&s, -1, &v);
+	assert(v.d == 3);
+	auraS_pop(&s, 1);
+	auraS_pushint(&s, 14);
+	assert(!auraS_dictget(&s, 1));
+	int n = 0, iter = 0;
+	while ((iter = auraS_dictnext(&s, 1, iter))) {
+		auraS_pop(&s, 2);
+		++n;
+	}
+	assert(n == 50 && auraS_dictlen(&s, 1) == 50);
+	printf("dict 50 keys, heap = %d\n", s.list_n);
 	return 0;
 }
 
@@ -3,12 +3,15 @@
 
 #include <stdint.h>
 #include <assert.h>
+#include <string.h>
 
 #include "aura.h"
 #include "atype.h"
 
 #define AURA_STACKSIZE 4096
-#define AURA_LISTSIZE (16*1024)
+#ifndef AURA_LISTSIZE
+#define AURA_LISTSIZE (16*1024)	// slots of the list heap, a dict of n keys takes 2 + 2 * capacity slots
+#endif
 
 union aura_var {
 	int d;
@@ -22,20 +25,195 @@ union aura_var {
 		uint16_t size;
 		int prog;
 	} slist;
+	struct {
+		uint32_t offset;
+		uint16_t size;
+		uint16_t buffer;
+	} str;
 	int word;
 	void * ud;
 };
 
+/*
+	A value is a (type, var) pair kept in two parallel arrays, or with AURA_NANBOX,
+	a single 64bit word : a float is stored as an unboxed double, other types are
+	boxed in the NaN space (sign and exponent all set, 4bits type code, 48bits payload).
+	Use the AURA_SLOT* macros to access value arrays in both modes.
+ */
+
+#ifdef AURA_NANBOX
+
+typedef uint64_t aura_slot;
+
+#define NANBOX_CANONICAL 0x7ff8000000000000ULL
+#define NANBOX_TAG(code) ((uint64_t)(0xfff0 | (code)) << 48)
+#define NANBOX_PAYLOAD 0xffffffffffffULL
+#define NANBOX_MIN NANBOX_TAG(1)
+
+static inline uint64_t
+nanbox_code_(int type) {
+	switch (type) {
+	case AURA_TLIST: return 1;
+	case AURA_TWORD: return 2;
+	case AURA_TINT: return 3;
+	case AURA_TFALSE: return 4;
+	case AURA_TWORDREF: return 5;
+	case AURA_TLOCAL: return 6;
+	case AURA_TLOCALSET: return 7;
+	case AURA_TCOROUTINE: return 8;
+	case AURA_TDLIST: return 9;
+	case AURA_TTRUE: return 10;
+	case AURA_TLISTCAP: return 11;
+	case AURA_TDICT: return 12;
+	case AURA_TSTRING: return 13;
+	case AURA_TARRAY: return 14;
+	case AURA_TSEQ: return 15;
+	default:
+		assert(0);
+		return 0;
+	}
+}
+
+static const uint8_t nanbox_type_[16] = {
+	0xff,
+	AURA_TLIST,
+	AURA_TWORD,
+	AURA_TINT,
+	AURA_TFALSE,
+	AURA_TWORDREF,
+	AURA_TLOCAL,
+	AURA_TLOCALSET,
+	AURA_TCOROUTINE,
+	AURA_TDLIST,
+	AURA_TTRUE,
+	AURA_TLISTCAP,
+	AURA_TDICT,
+	AURA_TSTRING,
+	AURA_TARRAY,
+	AURA_TSEQ,
+};
+
+static inline aura_slot
+auraS_box(int type, union aura_var v) {
+	uint64_t payload;
+	switch (type) {
+	case AURA_TFLOAT: {
+		double d = v.f;
+		if (d != d)
+			return NANBOX_CANONICAL;
+		aura_slot r;
+		memcpy(&r, &d, sizeof(r));
+		return r;
+	}
+	case AURA_TLIST:
+		payload = v.slist.offset | (uint64_t)v.slist.size << 16 | (uint64_t)(uint16_t)v.slist.prog << 32;
+		break;
+	case AURA_TDLIST:
+	case AURA_TLISTCAP:
+	case AURA_TDICT:
+	case AURA_TSEQ:
+		assert(v.dlist.offset < (1 << 24) && v.dlist.size < (1 << 24));
+		payload = v.dlist.offset | (uint64_t)v.dlist.size << 24;
+		break;
+	case AURA_TSTRING:
+		assert(v.str.offset < (1 << 20) && v.str.buffer < (1 << 12));
+		payload = v.str.offset | (uint64_t)v.str.size << 20 | (uint64_t)v.str.buffer << 36;
+		break;
+	case AURA_TTRUE:
+	case AURA_TFALSE:
+		payload = 0;
+		break;
+	default:
+		payload = (uint32_t)v.d;
+		break;
+	}
+	return NANBOX_TAG(nanbox_code_(type)) | payload;
+}
+
+static inline int
+auraS_boxtype(aura_slot s) {
+	if (s < NANBOX_MIN)
+		return AURA_TFLOAT;
+	return nanbox_type_[(s >> 48) & 0xf];
+}
+
+static inline int
+auraS_unbox(aura_slot s, union aura_var *v) {
+	if (s < NANBOX_MIN) {
+		double d;
+		memcpy(&d, &s, sizeof(d));
+		v->dlist.size = 0;
+		v->f = (float)d;
+		return AURA_TFLOAT;
+	}
+	int type = nanbox_type_[(s >> 48) & 0xf];
+	uint64_t payload = s & NANBOX_PAYLOAD;
+	if (type == AURA_TLIST) {
+		union aura_var r = { .slist = { (uint16_t)payload, (uint16_t)(payload >> 16), (int)(payload >> 32) } };
+		*v = r;
+	} else if (type == AURA_TSTRING) {
+		union aura_var r = { .str = { (uint32_t)(payload & 0xfffff), (uint16_t)(payload >> 20), (uint16_t)(payload >> 36) } };
+		*v = r;
+	} else {
+		// d overlaps dlist.offset
+		uint32_t lo = (uint32_t)payload, hi = 0;
+		if (type == AURA_TDLIST || type == AURA_TLISTCAP || type == AURA_TDICT || type == AURA_TSEQ) {
+			lo = (uint32_t)(payload & 0xffffff);
+			hi = (uint32_t)(payload >> 24);
+		}
+		union aura_var r = { .dlist = { lo, hi } };
+		*v = r;
+	}
+	return type;
+}
+
+#define AURA_SLOTS(t, v) aura_slot *v
+#define AURA_SLOTARRAY(t, v, n) aura_slot v[n]
+#define AURA_SLOTSIZE (sizeof(aura_slot))
+#define AURA_SLOTINIT(t, v, buffer, n) ((v) = (aura_slot *)(buffer))
+#define AURA_SLOTTYPE(t, v, i) auraS_boxtype((v)[i])
+#define AURA_SLOTGET(t, v, i, var) auraS_unbox((v)[i], var)
+#define AURA_SLOTSET(t, v, i, type, var) ((v)[i] = auraS_box(type, var))
+#define AURA_SLOTCOPY(t1, v1, i1, t2, v2, i2) ((v1)[i1] = (v2)[i2])
+
+#else
+
+#define AURA_SLOTS(t, v) uint8_t *t; union aura_var *v
+#define AURA_SLOTARRAY(t, v, n) uint8_t t[n]; union aura_var v[n]
+#define AURA_SLOTSIZE (sizeof(union aura_var) + 1)
+#define AURA_SLOTINIT(t, v, buffer, n) ((v) = (union aura_var *)(buffer), (t) = (uint8_t *)((v) + (n)))
+#define AURA_SLOTTYPE(t, v, i) ((t)[i])
+#define AURA_SLOTGET(t, v, i, var) (*(var) = (v)[i], (t)[i])
+#define AURA_SLOTSET(t, v, i, type, var) ((t)[i] = (type), (v)[i] = (var))
+#define AURA_SLOTCOPY(t1, v1, i1, t2, v2, i2) ((t1)[i1] = (t2)[i2], (v1)[i1] = (v2)[i2])
+
+#endif
+
+// The bytes of the strings : the source of a chunk or a host buffer, a string is (buffer, offset, size)
+struct aura_buffer {
+	const char *ptr;
+	int sz;
+};
+
+// The operand stack (type/v) can be switched, the list heap is shared
 struct aura_stack {
 	int top;
+	int size;
 	int list_n;
 	int list_heap;
-	uint8_t type[AURA_STACKSIZE];
-	uint8_t list_t[AURA_LISTSIZE];
-	union aura_var v[AURA_STACKSIZE];
-	union aura_var list[AURA_LISTSIZE];
+	const struct aura_buffer *buffer;
+	AURA_SLOTS(type, v);
+	AURA_SLOTARRAY(list_t, list, AURA_LISTSIZE);
 };
 
+// buffer holds size * AURA_SLOTSIZE bytes
+static inline void
+auraS_init(struct aura_stack *s, void *buffer, int size) {
+	s->top = 0;
+	s->size = size;
+	AURA_SLOTINIT(s->type, s->v, buffer, size);
+}
+
 static inline int
 auraS_absindex(struct aura_stack *s, int idx) {
 	return (idx > 0) ? idx : (s->top + idx + 1);
@@ -53,8 +231,7 @@ auraS_pop(struct aura_stack *s, int n) {
 
 static inline void
 copy_stack_(struct aura_stack *s, int to, int from) {
-	s->type[to-1] = s->type[from-1];
-	s->v[to-1] = s->v[from-1];
+	AURA_SLOTCOPY(s->type, s->v, to-1, s->type, s->v, from-1);
 }
 
 static inline void
@@ -72,18 +249,29 @@ auraS_copy(struct aura_stack *s, int fromidx, int toidx) {
 }
 
 
+static inline void
+swap_(struct aura_stack *s, int a, int b) {
+#ifdef AURA_NANBOX
+	aura_slot tmp = s->v[a];
+	s->v[a] = s->v[b];
+	s->v[b] = tmp;
+#else
+	uint8_t tmp_type = s->type[a];
+	union aura_var tmp_v = s->v[a];
+
+	s->type[a] = s->type[b];
+	s->v[a] = s->v[b];
+
+	s->type[b] = tmp_type;
+	s->v[b] = tmp_v;
+#endif
+}
+
 // See lua_rotate
 static void
 reverse_(struct aura_stack *s, int from, int to) {
 	for (; from < to; from++, to--) {
-		uint8_t tmp_type = s->type[from];
-		union aura_var tmp_v = s->v[from];
-
-		s->type[from] = s->type[to];
-		s->v[from] = s->v[to];
-
-		s->type[to] = tmp_type;
-		s->v[to] = tmp_v;
+		swap_(s, from, to);
 	}
 }
 
@@ -101,20 +289,13 @@ auraS_rotate(struct aura_stack *s, int idx, int n) {
 static inline void
 auraS_swap(struct aura_stack *s) {
 	int top = s->top;
-	uint8_t tmp_type = s->type[top-1];
-	union aura_var tmp_v = s->v[top-1];
-
-	s->type[top-1] = s->type[top-2];
-	s->v[top-1] = s->v[top-2];
-
-	s->type[top-2] = tmp_type;
-	s->v[top-2] = tmp_v;
+	swap_(s, top-1, top-2);
 }
 
 static inline int
 auraS_checkstack(struct aura_stack *s, int inc) {
 	int n = s->top + inc;
-	return (n >= 0 && n < AURA_STACKSIZE);
+	return (n >= 0 && n < s->size);
 }
 
 static inline int
@@ -123,59 +304,110 @@ auraS_checkstackid(struct aura_stack *s, int stkid) {
 }
 
 static inline void
-auraS_pushint(struct aura_stack *s, int v) {
+auraS_pushvar(struct aura_stack *s, int t, union aura_var v) {
 	int top = s->top++;
-	s->type[top] = AURA_TINT;
-	s->v[top].d = v;
+	AURA_SLOTSET(s->type, s->v, top, t, v);
+}
+
+static inline void
+auraS_pushint(struct aura_stack *s, int v) {
+	union aura_var var;
+	var.d = v;
+	auraS_pushvar(s, AURA_TINT, var);
 }
 
 static inline void
 auraS_pushfloat(struct aura_stack *s, float v) {
-	int top = s->top++;
-	s->type[top] = AURA_TFLOAT;
-	s->v[top].f = v;
+	union aura_var var;
+	var.f = v;
+	auraS_pushvar(s, AURA_TFLOAT, var);
 }
 
 static inline void
 auraS_pushboolean(struct aura_stack *s, int b) {
-	int top = s->top++;
-	s->type[top] = b ? AURA_TTRUE : AURA_TFALSE;
+	union aura_var var;
+	var.d = 0;
+	auraS_pushvar(s, b ? AURA_TTRUE : AURA_TFALSE, var);
 }
 
 static inline void
 auraS_pushlist(struct aura_stack *s, int list_offset, int list_size, int progid) {
-	int top = s->top++;
-	s->type[top] = AURA_TLIST;
-	s->v[top].slist.prog = progid;
-	s->v[top].slist.offset = (uint16_t)list_offset;
-	s->v[top].slist.size = (uint16_t)list_size;
+	union aura_var var;
+	var.slist.prog = progid;
+	var.slist.offset = (uint16_t)list_offset;
+	var.slist.size = (uint16_t)list_size;
+	auraS_pushvar(s, AURA_TLIST, var);
 }
 
 static inline void
 auraS_pushdlist(struct aura_stack *s, int list_offset, int list_size) {
-	int top = s->top++;
-	s->type[top] = AURA_TDLIST;
-	s->v[top].dlist.offset = (uint32_t)list_offset;
-	s->v[top].dlist.size = (uint32_t)list_size;
+	union aura_var var;
+	var.dlist.offset = (uint32_t)list_offset;
+	var.dlist.size = (uint32_t)list_size;
+	auraS_pushvar(s, AURA_TDLIST, var);
 }
 
 static inline void
 auraS_pushword(struct aura_stack *s, int word) {
-	int top = s->top++;
-	s->type[top] = AURA_TWORDREF;
-	s->v[top].word = word;
+	union aura_var var;
+	var.word = word;
+	auraS_pushvar(s, AURA_TWORDREF, var);
+}
+
+static inline void
+auraS_pushstring(struct aura_stack *s, int buffer, int offset, int sz) {
+	union aura_var var;
+	var.str.offset = (uint32_t)offset;
+	var.str.size = (uint16_t)sz;
+	var.str.buffer = (uint16_t)buffer;
+	auraS_pushvar(s, AURA_TSTRING, var);
+}
+
+static inline const char *
+auraS_string(struct aura_stack *s, union aura_var v) {
+	return s->buffer[v.str.buffer].ptr + v.str.offset;
+}
+
+// FNV-1a
+static inline uint32_t
+auraS_hashstring(const char *str, int sz) {
+	uint32_t h = 2166136261u;
+	int i;
+	for (i=0;i<sz;i++) {
+		h ^= (uint8_t)str[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static inline int
+auraS_samestring(struct aura_stack *s, union aura_var a, union aura_var b) {
+	return a.str.size == b.str.size && memcmp(auraS_string(s, a), auraS_string(s, b), a.str.size) == 0;
+}
+
+static inline int
+auraS_type(struct aura_stack *s, int stkid) {
+	stkid = auraS_absindex(s, stkid);
+	return AURA_SLOTTYPE(s->type, s->v, stkid-1);
 }
 
 static inline int
 auraS_get(struct aura_stack *s, int stkid, union aura_var *v) {
 	stkid = auraS_absindex(s, stkid);
-	*v = s->v[stkid-1];
-	return s->type[stkid-1];
+	return AURA_SLOTGET(s->type, s->v, stkid-1, v);
 }
 
 int auraS_createlist(struct aura_stack *s, int sz);
 int auraS_persistence(struct aura_stack *s);
 void auraS_setn(struct aura_stack *s, int index, int n);
 void auraS_getn(struct aura_stack *s, int index, int n);
+int auraS_append(struct aura_stack *s);
+int auraS_createdict(struct aura_stack *s, int n);
+int auraS_dictget(struct aura_stack *s, int index);
+int auraS_dictset(struct aura_stack *s, int index);
+int auraS_dictdel(struct aura_stack *s, int index);
+int auraS_dictnext(struct aura_stack *s, int index, int iter);
+int auraS_dictlen(struct aura_stack *s, int index);
+void auraS_copyheap(struct aura_stack *to, const struct aura_stack *from, int n);
 
 #endif
@@ -6,5 +6,7 @@
 #define AURA_TDLIST (AURA_TLIST | (1 << 4))
 #define AURA_TTRUE (AURA_TBOOLEAN | (1 << 4))
 #define AURA_TFALSE (AURA_TBOOLEAN | (0 << 4))
+#define AURA_TATOM (AURA_TWORD | (1 << 4))	// unresolved word in the parser output
+#define AURA_TLISTCAP (AURA_TLIST | (2 << 4))	// header of a growable list in the list heap
 
 #endif
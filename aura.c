@@ -3,54 +3,489 @@
 #include "aparser.h"
 #include "aword.h"
 #include "atype.h"
+#include "acache.h"
+#include "avector.h"
+#include "apool.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <setjmp.h>
+#include <limits.h>
+#ifdef AURA_PROFILE
+#include <time.h>
+#endif
 
 #define AURA_MAXPROG 4096
 #define AURA_LOCALFRAMESIZE 32
-#define AURA_MAXFRAME 32
+#define AURA_MAXFRAME 0x10000
+#define AURA_MAXCALL 0x10000
+#define AURA_MAXLOOP 64
+#define AURA_COSTACKSIZE 256
+#define AURA_MAXCOROUTINE 0x10000
+#define AURA_INLINESIZE 8
+#define AURA_INLINEDEPTH 4
+// pmap and pfold run serially below this size
+#ifndef AURA_PARALLELMIN
+#define AURA_PARALLELMIN 4096
+#endif
+#ifndef AURA_MAXWORKERS
+#define AURA_MAXWORKERS 32
+#endif
+// rows of a lock-step batch, and its registers
+#define AURA_LANES 64
+#define AURA_LANESTACK 16
+#define AURA_LANELOCALS 16
+#define AURA_MAXCARGS 3
+// calling contexts of the profiler, and the depth of a folded stack
+#ifndef AURA_PROFNODES
+#define AURA_PROFNODES 4096
+#endif
+#define AURA_PROFDEPTH 256
+// arguments of a memo word, and the slots of its cache
+#define AURA_MEMOARGS 4
+#ifndef AURA_MEMOSIZE
+#define AURA_MEMOSIZE 1024
+#endif
+
+#define OP_PUSH 0
+#define OP_LOCAL 1
+#define OP_SETLOCAL 2
+#define OP_CALL 3
+#define OP_JMP 4
+#define OP_JMPF 5
+#define OP_TIMES 6
+#define OP_FOR 7
+#define OP_INDEX 8
+#define OP_LOOP 9
+#define OP_RET 10
+#define OP_TAILCALL 11
+#define OP_ADD 12
+#define OP_SUB 13
+#define OP_MUL 14
+#define OP_DIV 15
+#define OP_GT 16
+#define OP_LT 17
+#define OP_GE 18
+#define OP_LE 19
+#define OP_EQ 20
+#define OP_NE 21
+#define OP_CCALL 22
+
+#define CI_CODE 0
+#define CI_DLIST 1
+#define CI_IF 2
+#define CI_IFELSE 3
+#define CI_WHILE 4
+#define CI_TIMES 5
+#define CI_FOR 6
+#define CI_MAP 7
+#define CI_FILTER 8
+#define CI_FOLD 9
+#define CI_SORTBY 10
+#define CI_SEQ 11
+#define CI_MEMO 12
+
+#define CO_SUSPENDED 0
+#define CO_RUNNING 1
+#define CO_NORMAL 2
+#define CO_DEAD 3
+
+#define INTERRUPT_SWITCH 1
+#define INTERRUPT_YIELD 2
+#define INTERRUPT_SUSPEND 3
+
+#define EXEC_DONE 0
+#define EXEC_BUDGET 1
+#define EXEC_YIELD 2
+#define EXEC_SUSPEND 3
 
 struct aura_stackframe {
 	uint8_t n;
 	uint8_t maxid;
 	uint8_t map[AURA_MAXLOCALS];
-	uint8_t t[AURA_LOCALFRAMESIZE];
-	union aura_var l[AURA_LOCALFRAMESIZE];
+	AURA_SLOTARRAY(t, l, AURA_LOCALFRAMESIZE);
+};
+
+// resolved target of a word
+struct aura_binding {
+	aura_cfunction func;
+	union {
+		void *ud;
+		struct {
+			int pc;
+			uint32_t gen;
+		} code;	// compiled code of cfunc_evalslist
+		int id[2];	// list of cfunc_evaldlist
+	} u;
+};
+
+struct aura_ins {
+	uint8_t op;
+	uint8_t t;
+	uint32_t epoch;	// the call site cache is checked in this epoch
+	union {
+		union aura_var v;
+		uint8_t local[4];
+		int word;
+		int jmp;
+		struct {
+			int word;
+			uint32_t version;	// version of the word when bound
+		} call;
+	} u;
+	struct aura_binding cache;	// inline cache of calls
+};
+
+struct aura_code {
+	int n;
+	int cap;
+	int label;	// last jump target, constants aren't folded across it
+	struct aura_ins *ins;
+};
+
+struct aura_codeslot {
+	uint32_t key;
+	int pc;
+};
+
+// (progid, list offset) -> compiled pc
+struct aura_codemap {
+	int n;
+	int cap;
+	struct aura_codeslot *slot;
+};
+
+/*
+	CI_CODE : pc is the compiled instruction
+	CI_DLIST : v[0] is the list, pc is the element index
+	CI_IF/CI_IFELSE : v[0] (and v[1]) are the branches, waiting for the condition
+	CI_WHILE : v[0] is the condition, v[1] is the body, pc is the phase
+	CI_TIMES : v[0] is the body, pc is the remaining count
+	CI_FOR : v[0] is the body, v[1].d is the limit, pc is the induction variable
+	CI_MAP : v[0] is the result (a copy of the list), v[1] is the body, pc is the element index,
+		n is 1 if the body runs in a copy of the frame (pmap)
+	CI_FILTER : as CI_MAP, n is the number of the kept elements
+	CI_FOLD : v[0] is the list, v[1] is the body, pc is the element index, n as CI_MAP (pfold)
+	CI_SORTBY : v[0] is the elements followed by their keys, n is the number of the elements, as CI_MAP
+	CI_SEQ : v[0] is the iteration state, v[1] is the body, n is the consumer, pc is the phase (see seq_resume)
+	CI_MEMO : n is the memo, pc is the stack top with the result, v[0].d is the slot, v[1].d is the stamp of the slot
+ */
+#ifdef AURA_PROFILE
+
+// a word call being profiled, word is -1 for none
+struct prof_frame {
+	int word;
+	int node;
+	int alloc;
+	int child_alloc;
+	uint64_t start;
+	uint64_t child;
+};
+
+struct prof_word {
+	uint32_t calls;
+	int active;	// nested calls of a recursive word, only the outermost one counts the total
+	uint64_t self;
+	uint64_t total;
+	uint64_t alloc;
+};
+
+// a node of the calling context tree, -1 is the root
+struct prof_node {
+	int parent;
+	int word;
+	uint64_t self;
+};
+
+struct aura_profiler {
+	int node_n;
+	struct prof_word word[AURA_MAXWORDS];
+	struct prof_node node[AURA_PROFNODES];
+	int slot[AURA_PROFNODES * 2];	// hash of (parent, word), the node + 1
+};
+
+// the compiler keeps the calls of the words, so each one is counted
+#define PROFILING(ctx) ((ctx)->prof != NULL)
+
+#else
+
+#define PROFILING(ctx) 0
+
+#endif
+
+struct aura_callinfo {
+	uint8_t kind;
+	uint8_t frame;	// owns a stackframe
+	uint8_t t[2];
+	int pc;
+	int n;
+	union aura_var v[2];
+#ifdef AURA_PROFILE
+	struct prof_frame prof;
+#endif
+};
+
+struct aura_async {
+	aura_asyncfunction func;
+	void *ud;
+};
+
+// types of a typed function
+#define CTYPE_INT 0
+#define CTYPE_FLOAT 1
+#define CTYPE_BOOL 2
+#define CTYPE_VOID 3
+
+// the result of a call, stamp is 0 for a free slot
+struct aura_memoslot {
+	uint32_t stamp;
+	uint8_t ready;
+	uint8_t t[AURA_MEMOARGS + 1];	// the arguments, then the result
+	int32_t v[AURA_MEMOARGS + 1];
+};
+
+struct aura_memo {
+	int n;
+	uint32_t stamp;
+	uint32_t hits;
+	uint32_t misses;
+	union aura_var body;
+	struct aura_memoslot *slot;	// AURA_MEMOSIZE slots, allocated at the first miss
+};
+
+struct aura_ctype {
+	aura_typedfunction func;
+	uint8_t n;
+	uint8_t ret;
+	uint8_t shape;	// (1 << n) | a bit for each float argument, selects the C prototype
+	uint8_t arg[AURA_MAXCARGS];
+	uint32_t key;	// the stack types of the arguments, 8 bits each, when they need no conversion
+};
+
+// host memory of an array value, ptr is NULL for a free slot (next is the free list then)
+struct aura_userdata {
+	void *ptr;
+	int type;
+	int n;
+	int gen;
+};
+
+// native induction variables of times/for
+struct aura_loop {
+	int i;
+	int limit;
+};
+
+// Execution state of a coroutine, the running one is loaded into aura_context
+struct aura_thread {
+	int top;
+	int size;
+	int stackframe;
+	int frame_cap;
+	int ci_n;
+	int ci_cap;
+	int loop_n;
+	AURA_SLOTS(type, v);
+	struct aura_stackframe *frame;
+	struct aura_callinfo *ci;
+	struct aura_loop *loop;
+};
+
+/*
+	Slot 0 is the main thread. The handle of a coroutine is slot | generation << 16,
+	so a handle of a dead coroutine never aliases the coroutine reusing its slot.
+ */
+struct aura_coroutine {
+	int id;
+	int status;
+	int resumer;	// slot of the resumer, -1 for the host
+	int active;	// running slot of the chain when the host step ends in a nested coroutine
+	int wait;	// the chain is suspended by an async function (root only)
+	int next;	// free list
+	struct aura_thread th;
+	struct aura_loop loop[AURA_MAXLOOP];
+	// operand stack follows
 };
 
 struct aura_context {
 	int stackframe;
+	int frame_cap;
+	int ci_n;
+	int ci_cap;
+	int loop_n;
+	int current;
+	int stepping;
+	int interrupt;
+	uint32_t epoch;
+	uint32_t codegen;	// bumped when compiled code is flushed
+	int inline_n;
+	int code_stale;	// the code has instructions of flushed lists
+	int inline_word[AURA_INLINEDEPTH];
+	int co_n;
+	int co_cap;
+	int co_free;
+	int async_n;
+	int async_cap;
+	int udata_n;
+	int udata_cap;
+	int udata_free;
+	int ctype_n;
+	int ctype_cap;
+	int memo_n;
+	int memo_cap;
+	int scratch_sz;
+	int worker_n;
+	int worker_max;	// 0 for the number of cpus
 	void *ud;
 	aura_errfunction errfunc;
+	struct aura_loadcache *loadcache;
+	struct aura_stackframe *frame;
+	struct aura_callinfo *ci;
+	struct aura_loop *loop;
+	struct aura_coroutine **co;
+	struct aura_async *async;
+	struct aura_userdata *udata;
+	struct aura_ctype *ctype;
+	struct aura_memo *memo;
+#ifdef AURA_PROFILE
+	struct aura_profiler *prof;	// NULL when off
+#endif
+	void *scratch;	// temporary arrays of the vector and sort words
+	struct aura_pool *pool;
+	struct aura_context **worker;	// contexts of pmap/pfold, worker[0] runs in the calling thread
+	struct aura_context *parent;	// the context of a worker
+	struct aura_code code;
+	struct aura_codemap codemap;
 	struct aura_wordlist words;
 	struct aura_locallist locals;
 	struct aura_stack stack;
-	struct aura_stackframe frame[AURA_MAXFRAME];
 	union list_node * prog[AURA_MAXPROG];
+	struct aura_buffer buffer[AURA_MAXPROG];	// a chunk source or a host buffer for each prog slot
 };
 
+static void
+save_thread(struct aura_context *ctx, struct aura_thread *th) {
+	th->top = ctx->stack.top;
+	th->size = ctx->stack.size;
+#ifndef AURA_NANBOX
+	th->type = ctx->stack.type;
+#endif
+	th->v = ctx->stack.v;
+	th->stackframe = ctx->stackframe;
+	th->frame_cap = ctx->frame_cap;
+	th->frame = ctx->frame;
+	th->ci_n = ctx->ci_n;
+	th->ci_cap = ctx->ci_cap;
+	th->ci = ctx->ci;
+	th->loop_n = ctx->loop_n;
+	th->loop = ctx->loop;
+}
+
+static void
+load_thread(struct aura_context *ctx, const struct aura_thread *th) {
+	ctx->stack.top = th->top;
+	ctx->stack.size = th->size;
+#ifndef AURA_NANBOX
+	ctx->stack.type = th->type;
+#endif
+	ctx->stack.v = th->v;
+	ctx->stackframe = th->stackframe;
+	ctx->frame_cap = th->frame_cap;
+	ctx->frame = th->frame;
+	ctx->ci_n = th->ci_n;
+	ctx->ci_cap = th->ci_cap;
+	ctx->ci = th->ci;
+	ctx->loop_n = th->loop_n;
+	ctx->loop = th->loop;
+}
+
+static void
+coroutine_switch(struct aura_context *ctx, int slot) {
+	save_thread(ctx, &ctx->co[ctx->current]->th);
+	load_thread(ctx, &ctx->co[slot]->th);
+	ctx->current = slot;
+}
+
+static void
+coroutine_kill(struct aura_context *ctx, int slot) {
+	struct aura_coroutine *co = ctx->co[slot];
+	if (co->status == CO_DEAD)
+		return;
+	co->status = CO_DEAD;
+	co->next = ctx->co_free;
+	ctx->co_free = slot;
+}
+
+// Kill the running chain of coroutines, returns 1 if it was stepped by the host
+static int
+unwind_coroutines(struct aura_context *ctx) {
+	int slot = ctx->current;
+	while (slot != 0) {
+		int resumer = ctx->co[slot]->resumer;
+		coroutine_kill(ctx, slot);
+		if (resumer < 0) {
+			coroutine_switch(ctx, ctx->stepping);
+			return 1;
+		}
+		slot = resumer;
+	}
+	if (ctx->current != 0)
+		coroutine_switch(ctx, 0);
+	ctx->co[0]->status = CO_RUNNING;
+	return 0;
+}
+
 static void
 raise_error(struct aura_context *ctx, const char *msg) {
-	auraS_settop(&ctx->stack, 0);
-	ctx->stackframe = 0;
+	ctx->interrupt = 0;
+	ctx->inline_n = 0;
+	if (!unwind_coroutines(ctx)) {
+		ctx->co[0]->wait = 0;
+		auraS_settop(&ctx->stack, 0);
+		ctx->stackframe = 0;
+		ctx->ci_n = 0;
+		ctx->loop_n = 0;
+	}
+#ifdef AURA_PROFILE
+	if (ctx->prof) {
+		// the calls abandoned by the error never return
+		int i;
+		for (i=0;i<AURA_MAXWORDS;i++)
+			ctx->prof->word[i].active = 0;
+	}
+#endif
 	ctx->errfunc(ctx->ud, msg);
 }
 
+// Frames live in a growable heap array, so recursion depth isn't bound to the C stack
 static void
 newframe(struct aura_context *ctx) {
-	int frame = ctx->stackframe++;
-	if (frame > AURA_MAXFRAME) {
-		raise_error(ctx, "stackframe overflow");
+	int frame = ctx->stackframe;
+	if (frame >= ctx->frame_cap) {
+		if (frame >= AURA_MAXFRAME)
+			raise_error(ctx, "stackframe overflow");
+		int cap = ctx->frame_cap ? ctx->frame_cap * 2 : 4;
+		struct aura_stackframe *f = (struct aura_stackframe *)realloc(ctx->frame, cap * sizeof(*f));
+		if (f == NULL)
+			raise_error(ctx, "Out of memory");
+		ctx->frame = f;
+		ctx->frame_cap = cap;
 	}
+	ctx->stackframe = frame + 1;
 	struct aura_stackframe *f = &ctx->frame[frame];
 	f->n = 0;
 	f->maxid = 0;
 }
 
+static inline void
+resetframe(struct aura_context *ctx) {
+	struct aura_stackframe *f = &ctx->frame[ctx->stackframe-1];
+	f->n = 0;
+	f->maxid = 0;
+}
+
 static inline void
 endframe(struct aura_context *ctx) {
 	--ctx->stackframe;
@@ -89,10 +524,35 @@ getlocal_index(struct aura_context *ctx, int localid) {
 	return index;
 }
 
+static void stop_workers(struct aura_context *ctx);
+
 void
 aura_close(struct aura_context *ctx) {
 	if (ctx == NULL)
 		return;
+	save_thread(ctx, &ctx->co[ctx->current]->th);
+	int i;
+	for (i=0;i<ctx->co_n;i++) {
+		struct aura_coroutine *co = ctx->co[i];
+		free(co->th.frame);
+		free(co->th.ci);
+		free(co);
+	}
+	free(ctx->co);
+	free(ctx->async);
+	free(ctx->udata);
+	free(ctx->ctype);
+	for (i=0;i<ctx->memo_n;i++) {
+		free(ctx->memo[i].slot);
+	}
+	free(ctx->memo);
+	free(ctx->scratch);
+#ifdef AURA_PROFILE
+	free(ctx->prof);
+#endif
+	stop_workers(ctx);
+	free(ctx->code.ins);
+	free(ctx->codemap.slot);
 	free(ctx);
 }
 
@@ -114,6 +574,9 @@ convert_word(struct aura_context *ctx, union list_node *data, const char * name,
 				raise_error(ctx, "Too many locals");
 			}
 			return AURA_TLOCAL;
+		case '"' :
+			// the data keeps the span in the source
+			return AURA_TSTRING;
 		case '(' :
 			if (sz == 2)
 				raise_error(ctx, "() not allows");
@@ -141,45 +604,167 @@ convert_node(struct aura_context *ctx, union list_node *node, int index, const c
 			convert_node(ctx, node, data->list.offset+i, source);
 		}
 		break;
-	case AURA_TWORD:
+	case AURA_TATOM:
 		node[index].index.type = convert_word(ctx, data, source + data->atom.offset, data->atom.len);
 		break;
 	}
 }
 
+/*
+	A chunk is a header node, the parser output (the prog), then a copy of the source.
+	header.list.offset is the source (in nodes) and header.list.n is its size.
+	If there was no room, the chunk is resolved at load and only the string literals are copied
+	(or header.list.n is 0 without strings).
+ */
+static inline const char *
+chunk_source(const union list_node *prog) {
+	return (const char *)(prog - 1 + prog[-1].list.offset);
+}
+
+// Words and locals are interned when a list is compiled the first time, sublists are resolved on their own
+static void
+resolve_block(struct aura_context *ctx, int progid, int offset, int n) {
+	union list_node *node = ctx->prog[progid];
+	int i;
+	for (i=0;i<n;i++) {
+		union list_node *index = &node[offset + i];
+		if (index->index.type == AURA_TATOM) {
+			union list_node *data = &node[index->index.offset];
+			index->index.type = convert_word(ctx, data, chunk_source(node) + data->atom.offset, data->atom.len);
+		}
+	}
+}
+
+// Copy the string literals of a resolved chunk after its nodes, returns the new size or -1 if they don't fit
+static int
+chunk_strings(union list_node *node, int offset, int n, const char *source, char *buf, int pos, int cap) {
+	int i;
+	for (i=0;i<n;i++) {
+		union list_node *index = &node[offset + i];
+		union list_node *data = &node[index->index.offset];
+		if (index->index.type == AURA_TLIST) {
+			pos = chunk_strings(node, data->list.offset, data->list.n, source, buf, pos, cap);
+			if (pos < 0)
+				return -1;
+		} else if (index->index.type == AURA_TSTRING) {
+			if (pos + data->atom.len > cap)
+				return -1;
+			memcpy(buf + pos, source + data->atom.offset, data->atom.len);
+			data->atom.offset = pos;
+			pos += data->atom.len;
+		}
+	}
+	return pos;
+}
+
 int
 aura_load(struct aura_context *ctx, const char *source, int sz, char output[AURA_MAXCHUNKSIZE]) {
 	if (sz > 0xffff)
 		raise_error(ctx, "Source too long");
-	int node_sz = AURA_MAXCHUNKSIZE / sizeof(union list_node);
-	union list_node *node = (union list_node *)output;
-	sz = auraP_parse(source, sz, node, node_sz);
-	if (sz < 0) {
+	if (ctx->loadcache) {
+		int r = auraC_get(ctx->loadcache, source, sz, output);
+		if (r >= 0)
+			return r;
+	}
+	int node_sz = AURA_MAXCHUNKSIZE / sizeof(union list_node) - 1;
+	union list_node *header = (union list_node *)output;
+	union list_node *node = header + 1;
+	int n = auraP_parse(source, sz, node, node_sz);
+	if (n < 0) {
 		raise_error(ctx, "Parse error");
 	}
-	convert_node(ctx, node, 0, source);
+	if (n > node_sz) {
+		raise_error(ctx, "Chunk too large");
+	}
 //	auraP_dump(node, source);
-
-	return sz * sizeof(union list_node);	
+	int src = 1 + n;
+	if (src * sizeof(union list_node) + sz <= AURA_MAXCHUNKSIZE) {
+		// lazy load : only the bracket structure is built, words are resolved on first compilation
+		memcpy(header + src, source, sz);
+		header->list.offset = src;
+		header->list.n = sz;
+		int r = src * sizeof(union list_node) + sz;
+		// an unresolved chunk doesn't depend on the context
+		if (ctx->loadcache)
+			auraC_put(ctx->loadcache, source, sz, output, r);
+		return r;
+	}
+	header->list.offset = 0;
+	header->list.n = 0;
+	convert_node(ctx, node, 0, source);
+	int strsz = chunk_strings(node, 0, 1, source, (char *)(header + src), 0, AURA_MAXCHUNKSIZE - src * sizeof(union list_node));
+	if (strsz < 0)
+		raise_error(ctx, "Chunk too large");
+	if (strsz > 0) {
+		header->list.offset = src;
+		header->list.n = strsz;
+	}
+	return src * sizeof(union list_node) + strsz;
 }
 
+// The cache may be shared by the contexts of one thread, the caller owns it
 void
-aura_register(struct aura_context *ctx, const char *name, aura_cfunction func, void *ud) {
-	if (auraW_register(&ctx->words, name, func, ud) < 0) {
-		raise_error(ctx, "Duplicate word");
-	}
+aura_setloadcache(struct aura_context *ctx, struct aura_loadcache *cache) {
+	ctx->loadcache = cache;
 }
 
+// invalidates the call site caches, epoch 0 is never valid
 static inline void
-execute(struct aura_context *ctx, int word) {
-	struct aura_word * w = &ctx->words.w[word];
-	if (w->func != NULL) {
-		w->func(ctx, w->u.ud);
+new_epoch(struct aura_context *ctx) {
+	if (++ctx->epoch == 0)
+		ctx->epoch = 1;
+	ctx->stack.buffer = ctx->buffer;
+}
+
+// No call runs compiled code : nothing is running and all the coroutines are dead
+static int
+code_unused(struct aura_context *ctx) {
+	if (ctx->ci_n > 0 || ctx->current != 0)
+		return 0;
+	int i;
+	for (i=1;i<ctx->co_n;i++) {
+		if (ctx->co[i]->status != CO_DEAD)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+	Deopt : forget the compiled lists, they are compiled again on their next call.
+	The running calls continue with the old code, it is reclaimed when no call can use it
+	(here or at the next aura_start).
+ */
+static void
+flush_code(struct aura_context *ctx) {
+	struct aura_codemap *m = &ctx->codemap;
+	if (m->cap)
+		memset(m->slot, 0, m->cap * sizeof(*m->slot));
+	m->n = 0;
+	int i;
+	for (i=0;i<ctx->words.n;i++) {
+		ctx->words.w[i].inlined = 0;
+	}
+	++ctx->codegen;
+	if (code_unused(ctx)) {
+		ctx->code.n = 0;
+		ctx->code.label = 0;
+		ctx->code_stale = 0;
 	} else {
-		raise_error(ctx, "Undefined Word");
+		ctx->code_stale = 1;
 	}
 }
 
+void
+aura_register(struct aura_context *ctx, const char *name, aura_cfunction func, void *ud) {
+	int id = auraW_register(&ctx->words, name, func, ud);
+	if (id < 0) {
+		raise_error(ctx, "Duplicate word");
+	}
+	if (ctx->words.w[id].inlined)
+		flush_code(ctx);
+	new_epoch(ctx);
+}
+
 static void
 set_locals(struct aura_context *ctx, const uint8_t locals[4]) {
 	int n;
@@ -188,446 +773,4747 @@ set_locals(struct aura_context *ctx, const uint8_t locals[4]) {
 			break;
 		}
 	}
-	auraS_checkstack(&ctx->stack, -n);
+	if (!auraS_checkstack(&ctx->stack, -n))
+		raise_error(ctx, "Stack empty");
 	struct aura_stackframe *f = currentframe(ctx);
 	int top = (ctx->stack.top -= n);
 	int i;
 	for (i=0;i<n;i++) {
 		int index = setlocal_index(ctx, locals[i]);
-		f->t[index] = ctx->stack.type[top + i];
-		f->l[index] = ctx->stack.v[top + i];
+		AURA_SLOTCOPY(f->t, f->l, index, ctx->stack.type, ctx->stack.v, top + i);
 	}
 }
 
-static void
-get_local(struct aura_context *ctx, int local) {
-	int index = getlocal_index(ctx, local);
-	struct aura_stackframe *f = currentframe(ctx);
-	int top = ctx->stack.top++;
-	ctx->stack.type[top] = f->t[index];
-	ctx->stack.v[top] = f->l[index];
+static void cfunc_if(struct aura_context *ctx, void *ud);
+static void cfunc_ifelse(struct aura_context *ctx, void *ud);
+static void cfunc_while(struct aura_context *ctx, void *ud);
+static void cfunc_times(struct aura_context *ctx, void *ud);
+static void cfunc_for(struct aura_context *ctx, void *ud);
+static void cfunc_map(struct aura_context *ctx, void *ud);
+static void cfunc_filter(struct aura_context *ctx, void *ud);
+static void cfunc_fold(struct aura_context *ctx, void *ud);
+static void cfunc_sortby(struct aura_context *ctx, void *ud);
+static void cfunc_each(struct aura_context *ctx, void *ud);
+static void cfunc_collect(struct aura_context *ctx, void *ud);
+static void cfunc_pmap(struct aura_context *ctx, void *ud);
+static void cfunc_pfold(struct aura_context *ctx, void *ud);
+static void seq_resume(struct aura_context *ctx, struct aura_callinfo *ci);
+static void memo_return(struct aura_context *ctx, struct aura_callinfo *ci);
+static void sort_dlist(struct aura_context *ctx, int offset, int n, int key);
+static void cfunc_basicmath(struct aura_context *ctx, void *ud);
+static void cfunc_typed(struct aura_context *ctx, void *ud);
+static int ctype_call(const struct aura_ctype *c, const union aura_var *a, union aura_var *r);
+static void cfunc_compare(struct aura_context *ctx, void *ud);
+static void cfunc_upeval(struct aura_context *ctx, void *ud);
+static void cfunc_evalslist(struct aura_context *ctx, void *ud);
+static void cfunc_evaldlist(struct aura_context *ctx, void *ud);
+static void cfunc_def(struct aura_context *ctx, void *ud);
+static void cfunc_memo(struct aura_context *ctx, void *ud);
+static void cfunc_defmemo(struct aura_context *ctx, void *ud);
+static void new_memo(struct aura_context *ctx, int word, int n, union aura_var body);
+static void cfunc_evaldict(struct aura_context *ctx, void *ud);
+
+struct slist_arg {
+	uint16_t offset;
+	uint16_t size;
+	int prog;
+};
+
+static int
+emit(struct aura_context *ctx, int op) {
+	struct aura_code *c = &ctx->code;
+	if (c->n >= c->cap) {
+		int cap = c->cap ? c->cap * 2 : 1024;
+		struct aura_ins *ins = (struct aura_ins *)realloc(c->ins, cap * sizeof(*ins));
+		if (ins == NULL)
+			raise_error(ctx, "Out of memory");
+		c->ins = ins;
+		c->cap = cap;
+	}
+	int pc = c->n++;
+	c->ins[pc].op = op;
+	c->ins[pc].t = 0;
+	c->ins[pc].epoch = 0;
+	c->ins[pc].cache.func = NULL;
+	return pc;
+}
+
+static inline void
+patch(struct aura_context *ctx, int pc, int target) {
+	ctx->code.ins[pc].u.jmp = target;
+}
+
+static inline int
+label(struct aura_context *ctx) {
+	return ctx->code.label = ctx->code.n;
+}
+
+static inline int
+is_literallist(const union list_node *node, int index) {
+	return node[index].index.type == AURA_TLIST;
+}
+
+// Only lower control words still bound to the builtin implementation
+static inline int
+is_control(struct aura_context *ctx, const union list_node *node, int index, aura_cfunction func) {
+	if (node[index].index.type != AURA_TWORD)
+		return 0;
+	int id = node[node[index].index.offset].word;
+	if (ctx->words.w[id].func != func)
+		return 0;
+	// lowered into jumps, rebinding the word flushes the code
+	ctx->words.w[id].inlined = 1;
+	return 1;
+}
+
+static void compile_block(struct aura_context *ctx, const union list_node *node, int offset, int n, int progid);
+
+// builtin arithmetic runs inline on the cached top of stack
+static int
+math_op(struct aura_context *ctx, int word) {
+	const struct aura_word *w = &ctx->words.w[word];
+	if (w->func == cfunc_compare)
+		return w->u.ud ? OP_NE : OP_EQ;
+	if (w->func != cfunc_basicmath)
+		return OP_CALL;
+	switch ((intptr_t)w->u.ud) {
+	case '+': return OP_ADD;
+	case '-': return OP_SUB;
+	case '*': return OP_MUL;
+	case '/': return OP_DIV;
+	case '>': return OP_GT;
+	case '<': return OP_LT;
+	case '}': return OP_GE;
+	case '{': return OP_LE;
+	default: return OP_CALL;
+	}
 }
 
 static void
-execute_listword(struct aura_context *ctx, const union list_node *node, int pc, int progid) {
-	const union list_node *ins = &node[pc];
-	int t = ins->index.type;
-	const union list_node *data = &node[ins->index.offset];
-	if (t == AURA_TWORD) {
-		execute(ctx, data->word);
-	} else if (t == AURA_TLOCALSET) {
-		set_locals(ctx, data->local);
-	} else {
-		if (!auraS_checkstack(&ctx->stack, 1)) {
-			raise_error(ctx, "Stack overflow");
-		}
-		switch (t) {
-		case AURA_TLIST:
-			auraS_pushlist(&ctx->stack, data->list.offset, data->list.n, progid);
-			break;
-		case AURA_TINT:
-			auraS_pushint(&ctx->stack, data->d);
-			break;
-		case AURA_TFLOAT:
-			auraS_pushfloat(&ctx->stack, data->f);
-			break;
-		case AURA_TTRUE:
-			auraS_pushboolean(&ctx->stack, 1);
-			break;
-		case AURA_TFALSE:
-			auraS_pushboolean(&ctx->stack, 0);
-			break;
-		case AURA_TWORDREF:
-			auraS_pushword(&ctx->stack, data->word);
-			break;
-		case AURA_TLOCAL:
-			get_local(ctx, data->word);
+compile_sublist(struct aura_context *ctx, const union list_node *node, int index, int progid) {
+	const union list_node *data = &node[node[index].index.offset];
+	compile_block(ctx, node, data->list.offset, data->list.n, progid);
+}
+
+// Constant folding : PUSH a, PUSH b, op -> PUSH (a op b)
+static int
+fold_math(struct aura_context *ctx, int word) {
+	int op = math_op(ctx, word);
+	struct aura_code *c = &ctx->code;
+	if (op == OP_CALL || c->n - 2 < c->label)
+		return 0;
+	const struct aura_ins *a = &c->ins[c->n-2];
+	const struct aura_ins *b = &c->ins[c->n-1];
+	if (a->op != OP_PUSH || b->op != OP_PUSH)
+		return 0;
+	int t;
+	union aura_var r;
+	r.d = 0;
+	if (a->t == AURA_TINT && b->t == AURA_TINT) {
+		int lv = a->u.v.d;
+		int rv = b->u.v.d;
+		t = AURA_TINT;
+		switch (op) {
+		case OP_ADD: r.d = lv + rv; break;
+		case OP_SUB: r.d = lv - rv; break;
+		case OP_MUL: r.d = lv * rv; break;
+		case OP_DIV:
+			if (rv == 0)
+				return 0;	// raise at runtime
+			r.d = lv / rv;
 			break;
-		default:
-			raise_error(ctx, "Unknown instruction");
+		case OP_GT: t = lv > rv ? AURA_TTRUE : AURA_TFALSE; break;
+		case OP_LT: t = lv < rv ? AURA_TTRUE : AURA_TFALSE; break;
+		case OP_GE: t = lv >= rv ? AURA_TTRUE : AURA_TFALSE; break;
+		case OP_LE: t = lv <= rv ? AURA_TTRUE : AURA_TFALSE; break;
+		case OP_EQ: t = lv == rv ? AURA_TTRUE : AURA_TFALSE; break;
+		case OP_NE: t = lv != rv ? AURA_TTRUE : AURA_TFALSE; break;
+		default: return 0;
+		}
+	} else if ((a->t == AURA_TINT || a->t == AURA_TFLOAT) && (b->t == AURA_TINT || b->t == AURA_TFLOAT)) {
+		float lv = a->t == AURA_TINT ? (float)a->u.v.d : a->u.v.f;
+		float rv = b->t == AURA_TINT ? (float)b->u.v.d : b->u.v.f;
+		t = AURA_TFLOAT;
+		switch (op) {
+		case OP_ADD: r.f = lv + rv; break;
+		case OP_SUB: r.f = lv - rv; break;
+		case OP_MUL: r.f = lv * rv; break;
+		case OP_DIV:
+			if (rv == 0)
+				return 0;
+			r.f = lv / rv;
 			break;
+		case OP_GT: t = lv > rv ? AURA_TTRUE : AURA_TFALSE; break;
+		case OP_LT: t = lv < rv ? AURA_TTRUE : AURA_TFALSE; break;
+		case OP_GE: t = lv >= rv ? AURA_TTRUE : AURA_TFALSE; break;
+		case OP_LE: t = lv <= rv ? AURA_TTRUE : AURA_TFALSE; break;
+		case OP_EQ: t = lv == rv ? AURA_TTRUE : AURA_TFALSE; break;
+		case OP_NE: t = lv != rv ? AURA_TTRUE : AURA_TFALSE; break;
+		default: return 0;
 		}
+	} else {
+		return 0;
 	}
+	c->n -= 2;
+	int pc = emit(ctx, OP_PUSH);
+	c->ins[pc].t = t;
+	c->ins[pc].u.v = r;
+	ctx->words.w[word].inlined = 1;
+	return 1;
 }
 
-static void
-execute_slist(struct aura_context *ctx, const union list_node *node, int offset, int n, int progid) {
-	int i;
-	for (i=0;i<n;i++) {
-		execute_listword(ctx, node, offset+i, progid);
-	}
+// builtins evaluate lists in the current frame, an inlined body would share the frame of its caller
+static inline int
+is_framecontrol(aura_cfunction func) {
+	return func == cfunc_upeval || func == cfunc_if || func == cfunc_ifelse
+		|| func == cfunc_while || func == cfunc_times || func == cfunc_for
+		|| func == cfunc_map || func == cfunc_filter || func == cfunc_fold
+		|| func == cfunc_sortby || func == cfunc_each || func == cfunc_collect
+		|| func == cfunc_pmap || func == cfunc_pfold;
 }
 
-static void
-execute_dlistword(struct aura_context *ctx, const uint8_t *type, const union aura_var *var, int pc) {
-	int t = type[pc];
-	if (t == AURA_TWORD) {
-		execute(ctx, var[pc].word);
-	} else {
-		union aura_var v = var[pc];
-		if (!auraS_checkstack(&ctx->stack, 1)) {
-			raise_error(ctx, "Stack overflow");
-		}
-		switch (t) {
-		case AURA_TLIST:
-			auraS_pushlist(&ctx->stack, v.slist.offset, v.slist.size, v.slist.prog);
-			break;
-		case AURA_TDLIST:
-			auraS_pushdlist(&ctx->stack, v.dlist.offset, v.dlist.size);
-			break;
+/*
+	Inline small words into their callers. The body must not need a frame :
+	only literals and words, no locals, no lists, no frame controls.
+	Rebinding an inlined word flushes the compiled code (see aura_register).
+ */
+static int
+inline_word(struct aura_context *ctx, int word) {
+	struct aura_word *w = &ctx->words.w[word];
+	if (w->func != cfunc_evalslist || ctx->inline_n >= AURA_INLINEDEPTH)
+		return 0;
+	int i;
+	for (i=0;i<ctx->inline_n;i++) {
+		if (ctx->inline_word[i] == word)
+			return 0;	// recursive
+	}
+	union {
+		void *ud;
+		struct slist_arg arg;
+	} u;
+	u.ud = w->u.ud;
+	if (u.arg.size > AURA_INLINESIZE)
+		return 0;
+	resolve_block(ctx, u.arg.prog, u.arg.offset, u.arg.size);
+	const union list_node *node = ctx->prog[u.arg.prog];
+	for (i=0;i<u.arg.size;i++) {
+		const union list_node *n = &node[u.arg.offset + i];
+		switch (n->index.type) {
 		case AURA_TINT:
-			auraS_pushint(&ctx->stack, v.d);
-			break;
 		case AURA_TFLOAT:
-			auraS_pushfloat(&ctx->stack, v.f);
-			break;
 		case AURA_TTRUE:
-			auraS_pushboolean(&ctx->stack, 1);
-			break;
 		case AURA_TFALSE:
-			auraS_pushboolean(&ctx->stack, 0);
-			break;
 		case AURA_TWORDREF:
-			auraS_pushboolean(&ctx->stack, 0);
+		case AURA_TSTRING:
 			break;
-		default:
-			raise_error(ctx, "Unknown instruction");
+		case AURA_TWORD:
+			if (is_framecontrol(ctx->words.w[node[n->index.offset].word].func))
+				return 0;
 			break;
+		default:
+			return 0;
 		}
 	}
+	ctx->inline_word[ctx->inline_n++] = word;
+	compile_block(ctx, node, u.arg.offset, u.arg.size, u.arg.prog);
+	--ctx->inline_n;
+	w->inlined = 1;
+	return 1;
 }
 
 static void
-execute_dlist(struct aura_context *ctx, union aura_var var) {
-	int i;
-	const uint8_t *t = &ctx->stack.list_t[var.dlist.offset];
-	const union aura_var *v = &ctx->stack.list[var.dlist.offset];
-	for (i=0;i<var.dlist.size;i++) {
-		execute_dlistword(ctx, t, v, i);
-	}
-}
-
-void
-aura_run(struct aura_context *ctx, int progid, void *code) {
-	if (progid < 0 || progid >= AURA_MAXPROG) {
-		raise_error(ctx, "Too many progs");
+compile_node(struct aura_context *ctx, const union list_node *node, int index, int progid) {
+	const union list_node *data = &node[node[index].index.offset];
+	int t = node[index].index.type;
+	int pc;
+	switch (t) {
+	case AURA_TWORD: {
+		if (!PROFILING(ctx) && (fold_math(ctx, data->word) || inline_word(ctx, data->word)))
+			break;
+		int op = math_op(ctx, data->word);
+		if (op == OP_CALL && ctx->words.w[data->word].func == cfunc_typed && !PROFILING(ctx))
+			op = OP_CCALL;
+		pc = emit(ctx, op);
+		struct aura_ins *ins = &ctx->code.ins[pc];
+		ins->u.call.word = data->word;
+		ins->u.call.version = ctx->words.w[data->word].version;
+		if (op != OP_CALL) {
+			// the inline arithmetic (or typed call) is valid while the word keeps this version
+			ins->cache.func = ctx->words.w[data->word].func;
+			ins->cache.u.ud = ctx->words.w[data->word].u.ud;
+			ins->epoch = ctx->epoch;
+		}
+		break;
 	}
-	union list_node *prog = (union list_node *)code;
-	if (prog == NULL) {
-		prog = ctx->prog[progid];
-	} else if (ctx->prog[progid] == NULL) {
-		ctx->prog[progid] = prog;
-	} else if (ctx->prog[progid] != prog) {
-		raise_error(ctx, "Duplicate prog");
+	case AURA_TLOCAL:
+		pc = emit(ctx, OP_LOCAL);
+		ctx->code.ins[pc].u.word = data->word;
+		break;
+	case AURA_TLOCALSET:
+		pc = emit(ctx, OP_SETLOCAL);
+		memcpy(ctx->code.ins[pc].u.local, data->local, 4);
+		break;
+	case AURA_TLIST:
+		pc = emit(ctx, OP_PUSH);
+		ctx->code.ins[pc].t = AURA_TLIST;
+		ctx->code.ins[pc].u.v.slist.offset = data->list.offset;
+		ctx->code.ins[pc].u.v.slist.size = data->list.n;
+		ctx->code.ins[pc].u.v.slist.prog = progid;
+		break;
+	case AURA_TINT:
+		pc = emit(ctx, OP_PUSH);
+		ctx->code.ins[pc].t = AURA_TINT;
+		ctx->code.ins[pc].u.v.d = data->d;
+		break;
+	case AURA_TFLOAT:
+		pc = emit(ctx, OP_PUSH);
+		ctx->code.ins[pc].t = AURA_TFLOAT;
+		ctx->code.ins[pc].u.v.f = data->f;
+		break;
+	case AURA_TTRUE:
+	case AURA_TFALSE:
+		pc = emit(ctx, OP_PUSH);
+		ctx->code.ins[pc].t = t;
+		break;
+	case AURA_TWORDREF:
+		pc = emit(ctx, OP_PUSH);
+		ctx->code.ins[pc].t = AURA_TWORDREF;
+		ctx->code.ins[pc].u.v.word = data->word;
+		break;
+	case AURA_TSTRING:
+		if (ctx->buffer[progid].ptr == NULL)
+			raise_error(ctx, "String needs the chunk source");
+		pc = emit(ctx, OP_PUSH);
+		ctx->code.ins[pc].t = AURA_TSTRING;
+		ctx->code.ins[pc].u.v.str.offset = data->atom.offset + 1;
+		ctx->code.ins[pc].u.v.str.size = data->atom.len - 2;
+		ctx->code.ins[pc].u.v.str.buffer = progid;
+		break;
+	default:
+		raise_error(ctx, "Unknown instruction");
+		break;
+	}
+}
+
+/*
+	Literal control structures are lowered into jumps :
+
+	[c] [a] [b] ifelse	: c JMPF(else) a JMP(end) else: b end:
+	[c] [a] if		: c JMPF(end) a end:
+	[c] [a] while		: loop: c JMPF(end) a JMP(loop) end:
+	[a] times		: TIMES(end) loop: a LOOP(loop) end:
+	[a] for			: FOR(end) loop: INDEX a LOOP(loop) end:
+ */
+static void
+compile_block(struct aura_context *ctx, const union list_node *node, int offset, int n, int progid) {
+	resolve_block(ctx, progid, offset, n);
+	int i = 0;
+	while (i < n) {
+		int index = offset + i;
+		int rest = n - i;
+		if (rest >= 4 && is_literallist(node, index) && is_literallist(node, index+1) && is_literallist(node, index+2)
+			&& is_control(ctx, node, index+3, cfunc_ifelse)) {
+			compile_sublist(ctx, node, index, progid);
+			int jf = emit(ctx, OP_JMPF);
+			compile_sublist(ctx, node, index+1, progid);
+			int j = emit(ctx, OP_JMP);
+			patch(ctx, jf, label(ctx));
+			compile_sublist(ctx, node, index+2, progid);
+			patch(ctx, j, label(ctx));
+			i += 4;
+		} else if (rest >= 3 && is_literallist(node, index) && is_literallist(node, index+1)
+			&& is_control(ctx, node, index+2, cfunc_if)) {
+			compile_sublist(ctx, node, index, progid);
+			int jf = emit(ctx, OP_JMPF);
+			compile_sublist(ctx, node, index+1, progid);
+			patch(ctx, jf, label(ctx));
+			i += 3;
+		} else if (rest >= 3 && is_literallist(node, index) && is_literallist(node, index+1)
+			&& is_control(ctx, node, index+2, cfunc_while)) {
+			int loop = label(ctx);
+			compile_sublist(ctx, node, index, progid);
+			int jf = emit(ctx, OP_JMPF);
+			compile_sublist(ctx, node, index+1, progid);
+			int j = emit(ctx, OP_JMP);
+			patch(ctx, j, loop);
+			patch(ctx, jf, label(ctx));
+			i += 3;
+		} else if (rest >= 2 && is_literallist(node, index)
+			&& (is_control(ctx, node, index+1, cfunc_times) || is_control(ctx, node, index+1, cfunc_for))) {
+			int isfor = is_control(ctx, node, index+1, cfunc_for);
+			int prep = emit(ctx, isfor ? OP_FOR : OP_TIMES);
+			int loop = label(ctx);
+			if (isfor)
+				emit(ctx, OP_INDEX);
+			compile_sublist(ctx, node, index, progid);
+			int j = emit(ctx, OP_LOOP);
+			patch(ctx, j, loop);
+			patch(ctx, prep, label(ctx));
+			i += 2;
+		} else {
+			compile_node(ctx, node, index, progid);
+			++i;
+		}
+	}
+}
+
+static inline uint32_t
+codemap_hash(uint32_t key) {
+	key ^= key >> 16;
+	key *= 0x45d9f3b;
+	key ^= key >> 16;
+	return key;
+}
+
+static int
+codemap_find(struct aura_codemap *m, uint32_t key) {
+	if (m->cap == 0)
+		return -1;
+	int mask = m->cap - 1;
+	int i = codemap_hash(key) & mask;
+	for (;;) {
+		struct aura_codeslot *slot = &m->slot[i];
+		if (slot->key == key)
+			return slot->pc;
+		if (slot->key == 0)
+			return -1;
+		i = (i + 1) & mask;
+	}
+}
+
+static void
+codemap_insert(struct aura_context *ctx, uint32_t key, int pc) {
+	struct aura_codemap *m = &ctx->codemap;
+	if ((m->n + 1) * 2 > m->cap) {
+		int cap = m->cap ? m->cap * 2 : 256;
+		struct aura_codeslot *slot = (struct aura_codeslot *)calloc(cap, sizeof(*slot));
+		if (slot == NULL)
+			raise_error(ctx, "Out of memory");
+		struct aura_codemap old = *m;
+		m->slot = slot;
+		m->cap = cap;
+		m->n = 0;
+		int i;
+		for (i=0;i<old.cap;i++) {
+			if (old.slot[i].key)
+				codemap_insert(ctx, old.slot[i].key, old.slot[i].pc);
+		}
+		free(old.slot);
+	}
+	int mask = m->cap - 1;
+	int i = codemap_hash(key) & mask;
+	while (m->slot[i].key != 0) {
+		i = (i + 1) & mask;
+	}
+	m->slot[i].key = key;
+	m->slot[i].pc = pc;
+	++m->n;
+}
+
+static inline int
+is_return(struct aura_context *ctx, int pc) {
+	const struct aura_ins *ins = ctx->code.ins;
+	while (ins[pc].op == OP_JMP)
+		pc = ins[pc].u.jmp;
+	return ins[pc].op == OP_RET;
+}
+
+// Static lists are compiled on first execution, and cached by (progid, offset)
+static int
+compile_list(struct aura_context *ctx, int progid, int offset, int n) {
+	// list offset is never 0 (node[0] is the root index)
+	uint32_t key = (uint32_t)progid << 16 | (uint32_t)offset;
+	int pc = codemap_find(&ctx->codemap, key);
+	if (pc >= 0)
+		return pc;
+	pc = label(ctx);
+	compile_block(ctx, ctx->prog[progid], offset, n, progid);
+	emit(ctx, OP_RET);
+	int i;
+	for (i=pc;i<ctx->code.n;i++) {
+		if (ctx->code.ins[i].op == OP_CALL && is_return(ctx, i+1))
+			ctx->code.ins[i].op = OP_TAILCALL;
+	}
+	codemap_insert(ctx, key, pc);
+	return pc;
+}
+
+/*
+	Profiler : the calls of the words defined by lists are timed from their callinfo to their endcall,
+	the calls of the C functions around the function. The time of a call is subtracted from the self time
+	of the nearest profiled call below it.
+ */
+#ifdef AURA_PROFILE
+
+static inline uint64_t
+prof_clock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+static inline int
+prof_alloc(struct aura_context *ctx) {
+	return ctx->stack.list_n + ctx->stack.list_heap;
+}
+
+static struct prof_frame *
+prof_parent(struct aura_context *ctx, int level) {
+	while (--level >= 0) {
+		if (ctx->ci[level].prof.word >= 0)
+			return &ctx->ci[level].prof;
+	}
+	return NULL;
+}
+
+// The calling context of word under parent, the tree stops growing when it's full
+static int
+prof_node(struct aura_profiler *p, int parent, int word) {
+	unsigned h = ((unsigned)parent * 2654435761u ^ (unsigned)word) % (AURA_PROFNODES * 2);
+	for (;;) {
+		int id = p->slot[h] - 1;
+		if (id < 0)
+			break;
+		if (p->node[id].parent == parent && p->node[id].word == word)
+			return id;
+		if (++h == AURA_PROFNODES * 2)
+			h = 0;
+	}
+	if (p->node_n >= AURA_PROFNODES)
+		return parent;
+	int id = p->node_n++;
+	p->node[id].parent = parent;
+	p->node[id].word = word;
+	p->node[id].self = 0;
+	p->slot[h] = id + 1;
+	return id;
+}
+
+static void
+prof_begin(struct aura_context *ctx, struct prof_frame *f, int level, int word) {
+	struct aura_profiler *p = ctx->prof;
+	struct prof_frame *parent = prof_parent(ctx, level);
+	f->word = word;
+	f->node = prof_node(p, parent ? parent->node : -1, word);
+	f->alloc = prof_alloc(ctx);
+	f->child_alloc = 0;
+	f->child = 0;
+	++p->word[word].calls;
+	++p->word[word].active;
+	f->start = prof_clock();
+}
+
+static void
+prof_end(struct aura_context *ctx, struct prof_frame *f, int level) {
+	uint64_t total = prof_clock() - f->start;
+	struct aura_profiler *p = ctx->prof;
+	struct prof_word *w = &p->word[f->word];
+	int alloc = prof_alloc(ctx) - f->alloc;
+	if (alloc < 0)
+		alloc = 0;
+	uint64_t self = total > f->child ? total - f->child : 0;
+	w->self += self;
+	if (alloc > f->child_alloc)
+		w->alloc += alloc - f->child_alloc;
+	if (w->active > 0 && --w->active == 0)
+		w->total += total;
+	if (f->node >= 0)
+		p->node[f->node].self += self;
+	struct prof_frame *parent = prof_parent(ctx, level);
+	if (parent) {
+		parent->child += total;
+		parent->child_alloc += alloc;
+	}
+	f->word = -1;
+}
+
+static void
+prof_leave(struct aura_context *ctx, struct aura_callinfo *ci) {
+	if (ctx->prof)
+		prof_end(ctx, &ci->prof, ci - ctx->ci);
+	ci->prof.word = -1;
+}
+
+#define PROF_ENTER(ctx, ci, w) if ((ctx)->prof) prof_begin(ctx, &(ci)->prof, (ci) - (ctx)->ci, w)
+#define PROF_LEAVE(ctx, ci) if ((ci)->prof.word >= 0) prof_leave(ctx, ci)
+
+#else
+
+#define PROF_ENTER(ctx, ci, w)
+#define PROF_LEAVE(ctx, ci)
+
+#endif
+
+static struct aura_callinfo *
+newcall(struct aura_context *ctx, int kind) {
+	int n = ctx->ci_n;
+	if (n >= ctx->ci_cap) {
+		if (n >= AURA_MAXCALL)
+			raise_error(ctx, "Call stack overflow");
+		int cap = ctx->ci_cap ? ctx->ci_cap * 2 : 16;
+		struct aura_callinfo *ci = (struct aura_callinfo *)realloc(ctx->ci, cap * sizeof(*ci));
+		if (ci == NULL)
+			raise_error(ctx, "Out of memory");
+		ctx->ci = ci;
+		ctx->ci_cap = cap;
+	}
+	ctx->ci_n = n + 1;
+	struct aura_callinfo *ci = &ctx->ci[n];
+	ci->kind = kind;
+	ci->frame = 0;
+	ci->pc = 0;
+#ifdef AURA_PROFILE
+	ci->prof.word = -1;
+#endif
+	return ci;
+}
+
+static inline void
+endcall(struct aura_context *ctx) {
+	struct aura_callinfo *ci = &ctx->ci[--ctx->ci_n];
+	PROF_LEAVE(ctx, ci);
+	if (ci->frame)
+		endframe(ctx);
+}
+
+// Lists are compiled when the word is bound, so a bound call doesn't look up the codemap
+static void
+bind_word(struct aura_context *ctx, int word, struct aura_binding *b) {
+	const struct aura_word *w = &ctx->words.w[word];
+	b->func = w->func;
+	if (w->func == cfunc_evalslist) {
+		union {
+			void *ud;
+			struct slist_arg arg;
+		} u;
+		u.ud = w->u.ud;
+		b->u.code.pc = compile_list(ctx, u.arg.prog, u.arg.offset, u.arg.size);
+		b->u.code.gen = ctx->codegen;
+	} else if (w->func == cfunc_evaldlist || w->func == cfunc_evaldict) {
+		b->u.id[0] = w->u.id[0];
+		b->u.id[1] = w->u.id[1];
+	} else if (w->func != NULL) {
+		b->u.ud = w->u.ud;
+	} else {
+		raise_error(ctx, "Undefined Word");
+	}
+}
+
+/*
+	Words defined by lists don't recurse through C : the callee is pushed onto the call stack,
+	or replaces the current call when the word is in tail position.
+	Returns 1 if the call stack changed.
+ */
+static int
+call_binding(struct aura_context *ctx, struct aura_binding b, int word, int tail) {
+	struct aura_callinfo *ci;
+	if (b.func == cfunc_evalslist) {
+		if (tail) {
+			ci = &ctx->ci[ctx->ci_n-1];
+			PROF_LEAVE(ctx, ci);
+			if (ci->frame) {
+				resetframe(ctx);
+			} else {
+				newframe(ctx);
+				ci->frame = 1;
+			}
+			ci->kind = CI_CODE;
+		} else {
+			ci = newcall(ctx, CI_CODE);
+			newframe(ctx);
+			ci->frame = 1;
+		}
+		ci->pc = b.u.code.pc;
+		PROF_ENTER(ctx, ci, word);
+		return 1;
+	} else if (b.func == cfunc_evaldlist) {
+		if (tail) {
+			ci = &ctx->ci[ctx->ci_n-1];
+			PROF_LEAVE(ctx, ci);
+			if (ci->frame) {
+				endframe(ctx);
+				ci->frame = 0;
+			}
+			ci->kind = CI_DLIST;
+		} else {
+			ci = newcall(ctx, CI_DLIST);
+		}
+		ci->pc = 0;
+		ci->v[0].dlist.offset = b.u.id[0];
+		ci->v[0].dlist.size = b.u.id[1];
+		PROF_ENTER(ctx, ci, word);
+		return 1;
+	} else {
+		// builtins such as eval schedule their work on the call stack
+		int n = ctx->ci_n;
+#ifdef AURA_PROFILE
+		if (ctx->prof) {
+			struct prof_frame f;
+			prof_begin(ctx, &f, n, word);
+			b.func(ctx, b.u.ud);
+			if (ctx->prof)
+				prof_end(ctx, &f, n < ctx->ci_n ? n : ctx->ci_n);
+			return ctx->ci_n != n || ctx->interrupt;
+		}
+#endif
+		b.func(ctx, b.u.ud);
+		return ctx->ci_n != n || ctx->interrupt;
+	}
+}
+
+static int
+call_word(struct aura_context *ctx, int word, int tail) {
+	struct aura_binding b;
+	bind_word(ctx, word, &b);
+	return call_binding(ctx, b, word, tail);
+}
+
+/*
+	Call sites cache the binding of their word. Any rebinding starts a new epoch,
+	then each site compares the version of its word once to revalidate.
+ */
+static int
+check_callsite(struct aura_context *ctx, struct aura_ins *ins) {
+	if (ins->cache.func == NULL || ins->u.call.version != ctx->words.w[ins->u.call.word].version)
+		return 0;
+	if (ins->cache.func == cfunc_evalslist && ins->cache.u.code.gen != ctx->codegen)
+		return 0;
+	ins->epoch = ctx->epoch;
+	return 1;
+}
+
+static void
+bind_callsite(struct aura_context *ctx, int pc) {
+	struct aura_ins *ins = &ctx->code.ins[pc];
+	if (check_callsite(ctx, ins))
+		return;
+	int word = ins->u.call.word;
+	struct aura_binding b;
+	bind_word(ctx, word, &b);
+	// binding may compile and move the code
+	ins = &ctx->code.ins[pc];
+	ins->cache = b;
+	ins->u.call.version = ctx->words.w[word].version;
+	ins->epoch = ctx->epoch;
+}
+
+static inline void
+rebind_word(struct aura_context *ctx, int word) {
+	++ctx->words.w[word].version;
+	new_epoch(ctx);
+}
+
+static void
+execute_dlistword(struct aura_context *ctx) {
+	struct aura_callinfo *ci = &ctx->ci[ctx->ci_n-1];
+	union aura_var list = ci->v[0];
+	int pc = ci->pc++;
+	if (pc >= list.dlist.size) {
+		endcall(ctx);
+		return;
+	}
+	union aura_var v;
+	int t = AURA_SLOTGET(ctx->stack.list_t, ctx->stack.list, list.dlist.offset + pc, &v);
+	if (t == AURA_TWORD) {
+		call_word(ctx, v.word, pc + 1 == list.dlist.size);
+		return;
+	}
+	if (!auraS_checkstack(&ctx->stack, 1)) {
+		raise_error(ctx, "Stack overflow");
+	}
+	switch (t) {
+	case AURA_TLIST:
+		auraS_pushlist(&ctx->stack, v.slist.offset, v.slist.size, v.slist.prog);
+		break;
+	case AURA_TDLIST:
+		auraS_pushdlist(&ctx->stack, v.dlist.offset, v.dlist.size);
+		break;
+	case AURA_TDICT:
+	case AURA_TSTRING:
+	case AURA_TARRAY:
+	case AURA_TSEQ:
+		auraS_pushvar(&ctx->stack, t, v);
+		break;
+	case AURA_TINT:
+		auraS_pushint(&ctx->stack, v.d);
+		break;
+	case AURA_TFLOAT:
+		auraS_pushfloat(&ctx->stack, v.f);
+		break;
+	case AURA_TTRUE:
+		auraS_pushboolean(&ctx->stack, 1);
+		break;
+	case AURA_TFALSE:
+		auraS_pushboolean(&ctx->stack, 0);
+		break;
+	case AURA_TWORDREF:
+		auraS_pushword(&ctx->stack, v.word);
+		break;
+	default:
+		raise_error(ctx, "Unknown instruction");
+		break;
+	}
+}
+
+static void
+push_eval(struct aura_context *ctx, int t, union aura_var var, int frame) {
+	struct aura_callinfo *ci;
+	if (t == AURA_TLIST) {
+		int pc = compile_list(ctx, var.slist.prog, var.slist.offset, var.slist.size);
+		ci = newcall(ctx, CI_CODE);
+		ci->pc = pc;
+	} else {
+		if (t != AURA_TDLIST)
+			raise_error(ctx, "Eval need a list");
+		ci = newcall(ctx, CI_DLIST);
+		ci->v[0] = var;
+	}
+	if (frame) {
+		newframe(ctx);
+		ci->frame = 1;
+	}
+}
+
+// The body of pmap and pfold runs in a copy of the frame of the caller, as it does in a worker
+static void
+push_eval_copy(struct aura_context *ctx, int t, union aura_var var) {
+	push_eval(ctx, t, var, 1);
+	if (ctx->stackframe > 1)
+		ctx->frame[ctx->stackframe-1] = ctx->frame[ctx->stackframe-2];
+}
+
+// An array id is the slot in the low bits and the generation of the slot above, so a freed id never matches a reused slot
+#define ARRAY_SLOTBITS 16
+#define ARRAY_SLOT(id) ((id) & ((1 << ARRAY_SLOTBITS) - 1))
+#define ARRAY_GEN(id) ((id) >> ARRAY_SLOTBITS)
+
+static struct aura_userdata *
+getarray(struct aura_context *ctx, int id) {
+	if (id < 0 || ARRAY_SLOT(id) >= ctx->udata_n)
+		raise_error(ctx, "Invalid array");
+	struct aura_userdata *u = &ctx->udata[ARRAY_SLOT(id)];
+	if (u->ptr == NULL || u->gen != ARRAY_GEN(id))
+		raise_error(ctx, "Invalid array");
+	return u;
+}
+
+static inline int
+array_get(const struct aura_userdata *u, int i, union aura_var *v) {
+	switch (u->type) {
+	case AURA_INT32:
+		v->d = ((const int32_t *)u->ptr)[i];
+		return AURA_TINT;
+	case AURA_FLOAT32:
+		v->f = ((const float *)u->ptr)[i];
+		return AURA_TFLOAT;
+	default:
+		v->f = (float)((const double *)u->ptr)[i];
+		return AURA_TFLOAT;
+	}
+}
+
+static inline int
+array_set(struct aura_userdata *u, int i, int t, union aura_var v) {
+	if (t != AURA_TINT && t != AURA_TFLOAT)
+		return 0;
+	switch (u->type) {
+	case AURA_INT32:
+		((int32_t *)u->ptr)[i] = t == AURA_TINT ? v.d : (int32_t)v.f;
+		break;
+	case AURA_FLOAT32:
+		((float *)u->ptr)[i] = t == AURA_TINT ? (float)v.d : v.f;
+		break;
+	default:
+		((double *)u->ptr)[i] = t == AURA_TINT ? (double)v.d : (double)v.f;
+		break;
+	}
+	return 1;
+}
+
+static inline int
+list_size(struct aura_context *ctx, int t, union aura_var list) {
+	switch (t) {
+	case AURA_TDLIST:
+		return list.dlist.size;
+	case AURA_TARRAY:
+		return getarray(ctx, list.d)->n;
+	default:
+		return list.slist.size;
+	}
+}
+
+// An element of a static list is a literal, the words are read as wordrefs
+static int
+list_get(struct aura_context *ctx, int t, union aura_var list, int i, union aura_var *v) {
+	if (t == AURA_TDLIST)
+		return AURA_SLOTGET(ctx->stack.list_t, ctx->stack.list, list.dlist.offset + i, v);
+	if (t == AURA_TARRAY)
+		return array_get(getarray(ctx, list.d), i, v);
+	resolve_block(ctx, list.slist.prog, list.slist.offset + i, 1);
+	const union list_node *node = ctx->prog[list.slist.prog];
+	const union list_node *index = &node[list.slist.offset + i];
+	const union list_node *data = &node[index->index.offset];
+	switch (index->index.type) {
+	case AURA_TINT:
+		v->d = data->d;
+		return AURA_TINT;
+	case AURA_TFLOAT:
+		v->f = data->f;
+		return AURA_TFLOAT;
+	case AURA_TLIST:
+		v->slist.offset = data->list.offset;
+		v->slist.size = data->list.n;
+		v->slist.prog = list.slist.prog;
+		return AURA_TLIST;
+	case AURA_TWORD:
+	case AURA_TWORDREF:
+		v->word = data->word;
+		return AURA_TWORDREF;
+	case AURA_TSTRING:
+		if (ctx->buffer[list.slist.prog].ptr == NULL)
+			raise_error(ctx, "String needs the chunk source");
+		v->str.offset = data->atom.offset + 1;
+		v->str.size = data->atom.len - 2;
+		v->str.buffer = list.slist.prog;
+		return AURA_TSTRING;
+	default:
+		raise_error(ctx, "Invalid list element");
+		return AURA_TFALSE;
+	}
+}
+
+static union aura_var
+new_dlist(struct aura_context *ctx, int n) {
+	if (!auraS_createlist(&ctx->stack, n))
+		raise_error(ctx, "Out of list memory");
+	union aura_var list;
+	auraS_get(&ctx->stack, -1, &list);
+	auraS_pop(&ctx->stack, 1);
+	return list;
+}
+
+// A dlist copy of the list, elements from start
+static union aura_var
+copy_dlist(struct aura_context *ctx, int t, union aura_var list, int n) {
+	union aura_var r = new_dlist(ctx, n);
+	int sz = list_size(ctx, t, list);
+	if (sz > n)
+		sz = n;
+	int i;
+	for (i=0;i<sz;i++) {
+		union aura_var v;
+		int vt = list_get(ctx, t, list, i, &v);
+		AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, r.dlist.offset + i, vt, v);
+	}
+	return r;
+}
+
+static inline void
+push_element(struct aura_context *ctx, int t, union aura_var list, int i) {
+	if (!auraS_checkstack(&ctx->stack, 1))
+		raise_error(ctx, "Stack overflow");
+	union aura_var v;
+	int vt = list_get(ctx, t, list, i, &v);
+	auraS_pushvar(&ctx->stack, vt, v);
+}
+
+static inline int
+pop_condition(struct aura_context *ctx) {
+	if (!auraS_checkstack(&ctx->stack, -1))
+		raise_error(ctx, "Stack empty");
+	--ctx->stack.top;
+	return AURA_SLOTTYPE(ctx->stack.type, ctx->stack.v, ctx->stack.top) != AURA_TFALSE;
+}
+
+// Resume a control builtin after the list it scheduled returns
+static void
+execute_continuation(struct aura_context *ctx) {
+	struct aura_callinfo *ci = &ctx->ci[ctx->ci_n-1];
+	int t;
+	union aura_var v;
+	switch (ci->kind) {
+	case CI_IF:
+		t = ci->t[0];
+		v = ci->v[0];
+		endcall(ctx);
+		if (pop_condition(ctx))
+			push_eval(ctx, t, v, 0);
+		break;
+	case CI_IFELSE:
+		if (pop_condition(ctx)) {
+			t = ci->t[0];
+			v = ci->v[0];
+		} else {
+			t = ci->t[1];
+			v = ci->v[1];
+		}
+		endcall(ctx);
+		push_eval(ctx, t, v, 0);
+		break;
+	case CI_WHILE:
+		if (ci->pc == 0) {
+			ci->pc = 1;
+			push_eval(ctx, ci->t[0], ci->v[0], 0);
+		} else if (pop_condition(ctx)) {
+			ci->pc = 0;
+			push_eval(ctx, ci->t[1], ci->v[1], 0);
+		} else {
+			endcall(ctx);
+		}
+		break;
+	case CI_TIMES:
+		if (ci->pc <= 0) {
+			endcall(ctx);
+		} else {
+			--ci->pc;
+			push_eval(ctx, ci->t[0], ci->v[0], 0);
+		}
+		break;
+	case CI_FOR:
+		if (ci->pc > ci->v[1].d) {
+			endcall(ctx);
+			break;
+		}
+		if (!auraS_checkstack(&ctx->stack, 1))
+			raise_error(ctx, "Stack overflow");
+		auraS_pushint(&ctx->stack, ci->pc);
+		if (ci->pc == ci->v[1].d) {
+			// last round, don't overflow the induction variable
+			ci->kind = CI_TIMES;
+			ci->pc = 0;
+		} else {
+			++ci->pc;
+		}
+		push_eval(ctx, ci->t[0], ci->v[0], 0);
+		break;
+	case CI_MAP:
+		v = ci->v[0];
+		if (ci->pc > 0) {
+			if (!auraS_checkstack(&ctx->stack, -1))
+				raise_error(ctx, "Stack empty");
+			int top = --ctx->stack.top;
+			AURA_SLOTCOPY(ctx->stack.list_t, ctx->stack.list, v.dlist.offset + ci->pc - 1, ctx->stack.type, ctx->stack.v, top);
+		}
+		if (ci->pc >= v.dlist.size) {
+			endcall(ctx);
+			auraS_pushdlist(&ctx->stack, v.dlist.offset, v.dlist.size);
+			break;
+		}
+		push_element(ctx, AURA_TDLIST, v, ci->pc++);
+		if (ci->n)
+			push_eval_copy(ctx, ci->t[1], ci->v[1]);
+		else
+			push_eval(ctx, ci->t[1], ci->v[1], 0);
+		break;
+	case CI_FILTER:
+		v = ci->v[0];
+		if (ci->pc > 0 && pop_condition(ctx)) {
+			AURA_SLOTCOPY(ctx->stack.list_t, ctx->stack.list, v.dlist.offset + ci->n,
+				ctx->stack.list_t, ctx->stack.list, v.dlist.offset + ci->pc - 1);
+			++ci->n;
+		}
+		if (ci->pc >= v.dlist.size) {
+			int n = ci->n;
+			endcall(ctx);
+			auraS_pushdlist(&ctx->stack, v.dlist.offset, n);
+			break;
+		}
+		push_element(ctx, AURA_TDLIST, v, ci->pc++);
+		push_eval(ctx, ci->t[1], ci->v[1], 0);
+		break;
+	case CI_SORTBY:
+		v = ci->v[0];
+		if (ci->pc > 0) {
+			if (!auraS_checkstack(&ctx->stack, -1))
+				raise_error(ctx, "Stack empty");
+			int top = --ctx->stack.top;
+			AURA_SLOTCOPY(ctx->stack.list_t, ctx->stack.list, v.dlist.offset + ci->n + ci->pc - 1, ctx->stack.type, ctx->stack.v, top);
+		}
+		if (ci->pc >= ci->n) {
+			int n = ci->n;
+			endcall(ctx);
+			sort_dlist(ctx, v.dlist.offset, n, v.dlist.offset + n);
+			auraS_pushdlist(&ctx->stack, v.dlist.offset, n);
+			break;
+		}
+		push_element(ctx, AURA_TDLIST, v, ci->pc++);
+		push_eval(ctx, ci->t[1], ci->v[1], 0);
+		break;
+	case CI_SEQ:
+		seq_resume(ctx, ci);
+		break;
+	case CI_MEMO:
+		memo_return(ctx, ci);
+		break;
+	case CI_FOLD:
+		if (ci->pc >= list_size(ctx, ci->t[0], ci->v[0])) {
+			endcall(ctx);
+			break;
+		}
+		push_element(ctx, ci->t[0], ci->v[0], ci->pc++);
+		if (ci->n)
+			push_eval_copy(ctx, ci->t[1], ci->v[1]);
+		else
+			push_eval(ctx, ci->t[1], ci->v[1], 0);
+		break;
+	default:
+		raise_error(ctx, "Invalid call");
+		break;
+	}
+}
+
+// The running coroutine returns, returns 0 if the control goes back to the host
+static int
+coroutine_return(struct aura_context *ctx) {
+	int slot = ctx->current;
+	if (slot == 0)
+		return 0;
+	struct aura_coroutine *co = ctx->co[slot];
+	union aura_var r;
+	int t = AURA_TFALSE;
+	if (ctx->stack.top > 0)
+		t = auraS_get(&ctx->stack, -1, &r);
+	int resumer = co->resumer;
+	coroutine_kill(ctx, slot);
+	if (resumer < 0)
+		return 0;
+	ctx->co[resumer]->status = CO_RUNNING;
+	coroutine_switch(ctx, resumer);
+	if (!auraS_checkstack(&ctx->stack, 1))
+		raise_error(ctx, "Stack overflow");
+	auraS_pushvar(&ctx->stack, t, r);
+	return 1;
+}
+
+// Run the call stack for at most budget steps
+#define SPILL_TOP() if (cached) { AURA_SLOTSET(s->type, s->v, top-1, tt, tv); cached = 0; }
+#define SYNC_TOP() { SPILL_TOP(); s->top = top; }
+// integer operands of the inline arithmetic, pops them and leaves the result cached
+#define MATH_OPERANDS() \
+	union aura_var left, right; \
+	int lt, rt; \
+	if (top < 2 || (ins->epoch != ctx->epoch && !check_callsite(ctx, ins))) \
+		goto math_call; \
+	lt = AURA_SLOTGET(s->type, s->v, top-2, &left); \
+	if (cached) { rt = tt; right = tv; } else { rt = AURA_SLOTGET(s->type, s->v, top-1, &right); } \
+	if (lt != AURA_TINT || rt != AURA_TINT) \
+		goto math_call; \
+	cached = 1; \
+	--top;
+#define POP_TOP(pt, pv) if (cached) { pt = tt; pv = tv; cached = 0; } else { pt = AURA_SLOTGET(s->type, s->v, top-1, &pv); } --top;
+
+static int
+execute_calls(struct aura_context *ctx, int budget) {
+	struct aura_stack *s = &ctx->stack;
+	struct aura_loop *l;
+	union aura_var v;
+	for (;;) {
+		if (ctx->interrupt) {
+			int interrupt = ctx->interrupt;
+			ctx->interrupt = 0;
+			if (interrupt == INTERRUPT_YIELD)
+				return EXEC_YIELD;
+			if (interrupt == INTERRUPT_SUSPEND)
+				return EXEC_SUSPEND;
+		}
+		if (ctx->ci_n == 0) {
+			if (coroutine_return(ctx))
+				continue;
+			return EXEC_DONE;
+		}
+		int cid = ctx->ci_n - 1;
+		if (ctx->ci[cid].kind != CI_CODE) {
+			if (--budget < 0)
+				return EXEC_BUDGET;
+			if (ctx->ci[cid].kind == CI_DLIST)
+				execute_dlistword(ctx);
+			else
+				execute_continuation(ctx);
+			continue;
+		}
+		int pc = ctx->ci[cid].pc;
+		// top of stack caching : top is s->top, the top value lives in (tt, tv) when cached
+		int top = s->top;
+		int cached = 0;
+		int tt = AURA_TFALSE;
+		union aura_var tv;
+		tv.d = 0;
+		// code may grow (and move) only when a call compiles a new list
+		struct aura_ins *code = ctx->code.ins;
+		for (;;) {
+			if (--budget < 0) {
+				SYNC_TOP();
+				ctx->ci[cid].pc = pc;
+				return EXEC_BUDGET;
+			}
+			struct aura_ins *ins = &code[pc++];
+			switch (ins->op) {
+			case OP_PUSH:
+				if (top + 1 >= s->size)
+					raise_error(ctx, "Stack overflow");
+				SPILL_TOP();
+				tt = ins->t;
+				tv = ins->u.v;
+				cached = 1;
+				++top;
+				break;
+			case OP_LOCAL: {
+				if (top + 1 >= s->size)
+					raise_error(ctx, "Stack overflow");
+				SPILL_TOP();
+				struct aura_stackframe *f = currentframe(ctx);
+				tt = AURA_SLOTGET(f->t, f->l, getlocal_index(ctx, ins->u.word), &tv);
+				cached = 1;
+				++top;
+				break;
+			}
+			case OP_SETLOCAL:
+				if (cached && ins->u.local[1] == AURA_INVALIDLOCAL) {
+					int index = setlocal_index(ctx, ins->u.local[0]);
+					struct aura_stackframe *f = currentframe(ctx);
+					AURA_SLOTSET(f->t, f->l, index, tt, tv);
+					cached = 0;
+					--top;
+				} else {
+					SYNC_TOP();
+					set_locals(ctx, ins->u.local);
+					top = s->top;
+				}
+				break;
+			case OP_ADD: {
+				MATH_OPERANDS();
+				tt = AURA_TINT;
+				tv.d = left.d + right.d;
+				break;
+			}
+			case OP_SUB: {
+				MATH_OPERANDS();
+				tt = AURA_TINT;
+				tv.d = left.d - right.d;
+				break;
+			}
+			case OP_MUL: {
+				MATH_OPERANDS();
+				tt = AURA_TINT;
+				tv.d = left.d * right.d;
+				break;
+			}
+			case OP_DIV: {
+				MATH_OPERANDS();
+				if (right.d == 0)
+					raise_error(ctx, "Divide zero");
+				tt = AURA_TINT;
+				tv.d = left.d / right.d;
+				break;
+			}
+			case OP_GT: {
+				MATH_OPERANDS();
+				tt = left.d > right.d ? AURA_TTRUE : AURA_TFALSE;
+				break;
+			}
+			case OP_LT: {
+				MATH_OPERANDS();
+				tt = left.d < right.d ? AURA_TTRUE : AURA_TFALSE;
+				break;
+			}
+			case OP_GE: {
+				MATH_OPERANDS();
+				tt = left.d >= right.d ? AURA_TTRUE : AURA_TFALSE;
+				break;
+			}
+			case OP_LE: {
+				MATH_OPERANDS();
+				tt = left.d <= right.d ? AURA_TTRUE : AURA_TFALSE;
+				break;
+			}
+			case OP_EQ: {
+				MATH_OPERANDS();
+				tt = left.d == right.d ? AURA_TTRUE : AURA_TFALSE;
+				break;
+			}
+			case OP_NE: {
+				MATH_OPERANDS();
+				tt = left.d != right.d ? AURA_TTRUE : AURA_TFALSE;
+				break;
+			}
+			case OP_CCALL: {
+				if (ins->epoch != ctx->epoch && !check_callsite(ctx, ins))
+					goto math_call;
+				const struct aura_ctype *c = &ctx->ctype[(intptr_t)ins->cache.u.ud];
+				int n = c->n;
+				if (top < n)
+					goto math_call;
+				union aura_var arg[AURA_MAXCARGS];
+				uint32_t key = 0;
+				int i;
+				for (i=0;i<n;i++) {
+					int t;
+					if (cached && i == n-1) {
+						t = tt;
+						arg[i] = tv;
+					} else {
+						t = AURA_SLOTGET(s->type, s->v, top-n+i, &arg[i]);
+					}
+					key |= (uint32_t)t << (i * 8);
+				}
+				// the arguments need a conversion (or raise)
+				if (key != c->key)
+					goto math_call;
+				if (n > 0) {
+					top -= n;
+					cached = 0;
+				}
+				int t = ctype_call(c, arg, &v);
+				if (t >= 0) {
+					if (top + 1 >= s->size)
+						raise_error(ctx, "Stack overflow");
+					SPILL_TOP();
+					tt = t;
+					tv = v;
+					cached = 1;
+					++top;
+				}
+				break;
+			}
+			math_call:
+				// other types, or the word is redefined
+				SYNC_TOP();
+				ctx->ci[cid].pc = pc;
+				if (call_word(ctx, ins->u.word, 0))
+					goto next;
+				top = s->top;
+				code = ctx->code.ins;
+				break;
+			case OP_CALL:
+			case OP_TAILCALL:
+				SYNC_TOP();
+				ctx->ci[cid].pc = pc;
+				if (ins->epoch != ctx->epoch) {
+					bind_callsite(ctx, pc - 1);
+					code = ctx->code.ins;
+					ins = &code[pc - 1];
+				}
+				if (call_binding(ctx, ins->cache, ins->u.call.word, ins->op == OP_TAILCALL))
+					goto next;
+				top = s->top;
+				code = ctx->code.ins;
+				break;
+			case OP_JMP:
+				pc = ins->u.jmp;
+				break;
+			case OP_JMPF: {
+				if (top < 1)
+					raise_error(ctx, "Stack empty");
+				--top;
+				int t = cached ? tt : AURA_SLOTTYPE(s->type, s->v, top);
+				cached = 0;
+				if (t == AURA_TFALSE)
+					pc = ins->u.jmp;
+				break;
+			}
+			case OP_TIMES:
+			case OP_FOR: {
+				int t;
+				if (ins->op == OP_TIMES) {
+					if (top < 1)
+						raise_error(ctx, "Stack empty");
+					POP_TOP(t, v);
+					if (t != AURA_TINT)
+						raise_error(ctx, "times need an integer");
+					if (v.d <= 0) {
+						pc = ins->u.jmp;
+						break;
+					}
+					if (ctx->loop_n >= AURA_MAXLOOP)
+						raise_error(ctx, "Too many nested loops");
+					l = &ctx->loop[ctx->loop_n++];
+					l->i = 1;
+					l->limit = v.d;
+				} else {
+					union aura_var from;
+					if (top < 2)
+						raise_error(ctx, "Stack empty");
+					POP_TOP(t, v);
+					int ft;
+					POP_TOP(ft, from);
+					if (t != AURA_TINT || ft != AURA_TINT)
+						raise_error(ctx, "for need integers");
+					if (from.d > v.d) {
+						pc = ins->u.jmp;
+						break;
+					}
+					if (ctx->loop_n >= AURA_MAXLOOP)
+						raise_error(ctx, "Too many nested loops");
+					l = &ctx->loop[ctx->loop_n++];
+					l->i = from.d;
+					l->limit = v.d;
+				}
+				break;
+			}
+			case OP_INDEX:
+				if (top + 1 >= s->size)
+					raise_error(ctx, "Stack overflow");
+				SPILL_TOP();
+				tt = AURA_TINT;
+				tv.d = ctx->loop[ctx->loop_n-1].i;
+				cached = 1;
+				++top;
+				break;
+			case OP_LOOP:
+				l = &ctx->loop[ctx->loop_n-1];
+				if (l->i < l->limit) {
+					++l->i;
+					pc = ins->u.jmp;
+				} else {
+					--ctx->loop_n;
+				}
+				break;
+			case OP_RET:
+				SYNC_TOP();
+				endcall(ctx);
+				goto next;
+			default:
+				raise_error(ctx, "Unknown instruction");
+				break;
+			}
+		}
+	next:
+		;
+	}
+}
+
+#undef SPILL_TOP
+#undef SYNC_TOP
+#undef POP_TOP
+#undef MATH_OPERANDS
+
+static union list_node *
+attach_prog(struct aura_context *ctx, int progid, void *code) {
+	if (progid < 0 || progid >= AURA_MAXPROG) {
+		raise_error(ctx, "Too many progs");
+	}
+	union list_node *prog = NULL;
+	if (code)
+		prog = (union list_node *)code + 1;	// skip the chunk header
+	if (prog == NULL) {
+		prog = ctx->prog[progid];
+	} else if (ctx->prog[progid] == NULL) {
+		if (ctx->buffer[progid].ptr)
+			raise_error(ctx, "Duplicate prog");
+		ctx->prog[progid] = prog;
+		if (prog[-1].list.n) {
+			ctx->buffer[progid].ptr = chunk_source(prog);
+			ctx->buffer[progid].sz = prog[-1].list.n;
+		}
+		new_epoch(ctx);
+	} else if (ctx->prog[progid] != prog) {
+		raise_error(ctx, "Duplicate prog");
+	}
+	if (prog == NULL) {
+		raise_error(ctx, "No prog");
+	}
+	int t = prog[0].index.type;
+	if (t != AURA_TLIST) {
+		raise_error(ctx, "Invalid code");
+	}
+	return prog;
+}
+
+void
+aura_start(struct aura_context *ctx, int progid, void *code) {
+	union list_node *prog = attach_prog(ctx, progid, code);
+	// abandon the coroutines a previous run left in progress
+	unwind_coroutines(ctx);
+	ctx->interrupt = 0;
+	ctx->co[0]->wait = 0;
+	ctx->stack.top = 0;
+	ctx->stack.list_n = 0;
+	ctx->stackframe = 0;
+	ctx->ci_n = 0;
+	ctx->loop_n = 0;
+	if (ctx->code_stale && code_unused(ctx))
+		flush_code(ctx);
+
+	const union list_node * node = &prog[prog[0].index.offset];
+	union aura_var root;
+	root.slist.offset = node->list.offset;
+	root.slist.size = node->list.n;
+	root.slist.prog = progid;
+	push_eval(ctx, AURA_TLIST, root, 1);
+}
+
+// Run at most budget instructions (no limit if budget <= 0), AURA_YIELD means unfinished
+static int
+execute(struct aura_context *ctx, int budget) {
+	if (budget > 0)
+		return execute_calls(ctx, budget);
+	int r;
+	while ((r = execute_calls(ctx, INT_MAX)) == EXEC_BUDGET) {}
+	return r;
+}
+
+static int
+exec_status(int r) {
+	switch (r) {
+	case EXEC_DONE:
+		return AURA_OK;
+	case EXEC_SUSPEND:
+		return AURA_SUSPEND;
+	default:
+		return AURA_YIELD;
+	}
+}
+
+int
+aura_resume(struct aura_context *ctx, int budget) {
+	if (ctx->co[0]->wait)
+		return AURA_SUSPEND;
+	return exec_status(execute(ctx, budget));
+}
+
+void
+aura_run(struct aura_context *ctx, int progid, void *code) {
+	aura_start(ctx, progid, code);
+	aura_resume(ctx, 0);
+}
+
+// Compare two resolved bodies, the words are compared by id so a renamed local or word is a change
+static int
+same_list(struct aura_context *ctx, int pa, int oa, int pb, int ob, int n) {
+	resolve_block(ctx, pa, oa, n);
+	resolve_block(ctx, pb, ob, n);
+	const union list_node *a = ctx->prog[pa];
+	const union list_node *b = ctx->prog[pb];
+	int i, j;
+	for (i=0;i<n;i++) {
+		int t = a[oa+i].index.type;
+		if (t != b[ob+i].index.type)
+			return 0;
+		const union list_node *da = &a[a[oa+i].index.offset];
+		const union list_node *db = &b[b[ob+i].index.offset];
+		switch (t) {
+		case AURA_TLIST:
+			if (da->list.n != db->list.n)
+				return 0;
+			if (!same_list(ctx, pa, da->list.offset, pb, db->list.offset, da->list.n))
+				return 0;
+			break;
+		case AURA_TFLOAT:
+			if (da->f != db->f)
+				return 0;
+			break;
+		case AURA_TLOCALSET:
+			for (j=0;j<4;j++) {
+				if (da->local[j] != db->local[j])
+					return 0;
+				if (da->local[j] == AURA_INVALIDLOCAL)
+					break;
+			}
+			break;
+		case AURA_TINT:
+		case AURA_TWORD:
+		case AURA_TWORDREF:
+		case AURA_TLOCAL:
+			if (da->word != db->word)
+				return 0;
+			break;
+		case AURA_TSTRING:
+			if (da->atom.len != db->atom.len
+				|| memcmp(chunk_source(a) + da->atom.offset, chunk_source(b) + db->atom.offset, da->atom.len) != 0)
+				return 0;
+			break;
+		}
+	}
+	return 1;
+}
+
+// [ body ] n 'name defmemo at i, returns 1 if the word is rebound. A new body or arity drops the cached results
+static int
+reload_memo(struct aura_context *ctx, int progid, const union list_node *prog, int i) {
+	const union list_node *list = &prog[prog[i].index.offset];
+	int n = prog[prog[i+1].index.offset].d;
+	int id = prog[prog[i+2].index.offset].word;
+	struct aura_word *w = &ctx->words.w[id];
+	union aura_var body;
+	body.slist.offset = list->list.offset;
+	body.slist.size = list->list.n;
+	body.slist.prog = progid;
+	if (n < 0 || n > AURA_MEMOARGS)
+		return 0;
+	if (w->func == NULL) {
+		new_memo(ctx, id, n, body);
+		return 1;
+	}
+	if (w->func != cfunc_memo)
+		return 0;	// a def word or a host word isn't turned into a memo word
+	struct aura_memo *m = &ctx->memo[(intptr_t)w->u.ud];
+	if (m->n == n && m->body.slist.size == body.slist.size
+		&& same_list(ctx, m->body.slist.prog, m->body.slist.offset, progid, body.slist.offset, body.slist.size)) {
+		m->body = body;
+		return 0;
+	}
+	m->n = n;
+	m->body = body;
+	if (m->slot)
+		memset(m->slot, 0, AURA_MEMOSIZE * sizeof(struct aura_memoslot));
+	m->hits = 0;
+	m->misses = 0;
+	if (w->inlined)
+		flush_code(ctx);
+	rebind_word(ctx, id);
+	return 1;
+}
+
+/*
+	Hot reload : code is a new chunk of the same program, it is attached as progid.
+	Only the top level [ body ] 'name def and [ body ] n 'name defmemo are applied (nothing else runs),
+	the words whose body changed or which are new are rebound to the new chunk, the others keep their old code
+	but refer to the new chunk too. The running calls continue with the code they have, so the old chunk must be
+	kept alive until aura_unload frees it. Returns the number of rebound words.
+ */
+int
+aura_reload(struct aura_context *ctx, int progid, void *code) {
+	union list_node *prog = attach_prog(ctx, progid, code);
+	const union list_node *root = &prog[prog[0].index.offset];
+	int offset = root->list.offset;
+	int n = root->list.n;
+	resolve_block(ctx, progid, offset, n);
+	int i;
+	int rebind = 0;
+	for (i=0;i+2<n;i++) {
+		const union list_node *body = &prog[offset+i];
+		const union list_node *name = &prog[offset+i+1];
+		const union list_node *def = &prog[offset+i+2];
+		if (i+3<n && body->index.type == AURA_TLIST
+			&& name->index.type == AURA_TINT
+			&& def->index.type == AURA_TWORDREF
+			&& prog[offset+i+3].index.type == AURA_TWORD
+			&& ctx->words.w[prog[prog[offset+i+3].index.offset].word].func == cfunc_defmemo) {
+			rebind += reload_memo(ctx, progid, prog, offset+i);
+			i += 3;
+			continue;
+		}
+		if (body->index.type != AURA_TLIST
+			|| name->index.type != AURA_TWORDREF
+			|| def->index.type != AURA_TWORD
+			|| ctx->words.w[prog[def->index.offset].word].func != cfunc_def)
+			continue;
+		const union list_node *list = &prog[body->index.offset];
+		int id = prog[name->index.offset].word;
+		struct aura_word *w = &ctx->words.w[id];
+		if (w->func != NULL && w->func != cfunc_evalslist && w->func != cfunc_evaldlist)
+			continue;	// the host words can't be redefined
+		union {
+			void *ud;
+			struct slist_arg arg;
+		} u;
+		if (w->func == cfunc_evalslist) {
+			u.ud = w->u.ud;
+			if (u.arg.size == list->list.n
+				&& same_list(ctx, u.arg.prog, u.arg.offset, progid, list->list.offset, u.arg.size)) {
+				u.arg.offset = list->list.offset;
+				u.arg.prog = progid;
+				w->u.ud = u.ud;
+				i += 2;
+				continue;
+			}
+		}
+		u.arg.offset = list->list.offset;
+		u.arg.size = list->list.n;
+		u.arg.prog = progid;
+		w->func = cfunc_evalslist;
+		w->u.ud = u.ud;
+		if (w->inlined)
+			flush_code(ctx);
+		rebind_word(ctx, id);
+		++rebind;
+		i += 2;
+	}
+	return rebind;
+}
+
+static inline int
+refer_prog(int t, union aura_var v, int progid) {
+	return (t == AURA_TLIST && v.slist.prog == progid) || (t == AURA_TSTRING && v.str.buffer == progid);
+}
+
+/*
+	Free the slot of a chunk (or of a host buffer), so its progid can be loaded again.
+	Returns 0 and keeps it while a running call, a word, a memo word, or a value on the stack or in the heap refers to it.
+	The compiled code is flushed, the words are compiled again from the chunks they refer to.
+ */
+int
+aura_unload(struct aura_context *ctx, int progid) {
+	if (progid < 0 || progid >= AURA_MAXPROG)
+		raise_error(ctx, "Invalid prog");
+	if (!code_unused(ctx))
+		return 0;
+	int i;
+	for (i=0;i<ctx->words.n;i++) {
+		const struct aura_word *w = &ctx->words.w[i];
+		if (w->func == cfunc_evalslist) {
+			union {
+				void *ud;
+				struct slist_arg arg;
+			} u;
+			u.ud = w->u.ud;
+			if (u.arg.prog == progid)
+				return 0;
+		}
+	}
+	for (i=0;i<ctx->memo_n;i++) {
+		if (ctx->memo[i].body.slist.prog == progid)
+			return 0;
+	}
+	union aura_var v;
+	for (i=0;i<ctx->stack.top;i++) {
+		int t = AURA_SLOTGET(ctx->stack.type, ctx->stack.v, i, &v);
+		if (refer_prog(t, v, progid))
+			return 0;
+	}
+	// the temporary heap, then the persistent heap
+	for (i=0;i<ctx->stack.list_n;i++) {
+		int t = AURA_SLOTGET(ctx->stack.list_t, ctx->stack.list, i, &v);
+		if (refer_prog(t, v, progid))
+			return 0;
+	}
+	for (i=AURA_LISTSIZE - ctx->stack.list_heap;i<AURA_LISTSIZE;i++) {
+		int t = AURA_SLOTGET(ctx->stack.list_t, ctx->stack.list, i, &v);
+		if (refer_prog(t, v, progid))
+			return 0;
+	}
+	ctx->prog[progid] = NULL;
+	ctx->buffer[progid].ptr = NULL;
+	ctx->buffer[progid].sz = 0;
+	flush_code(ctx);
+	new_epoch(ctx);
+	return 1;
+}
+
+static int
+newcoroutine(struct aura_context *ctx, int size) {
+	struct aura_coroutine *co;
+	int slot = ctx->co_free;
+	if (slot >= 0) {
+		co = ctx->co[slot];
+		ctx->co_free = co->next;
+		co->id = (int)((unsigned)co->id + 0x10000);
+	} else {
+		slot = ctx->co_n;
+		if (slot >= ctx->co_cap) {
+			if (slot >= AURA_MAXCOROUTINE)
+				raise_error(ctx, "Too many coroutines");
+			int cap = ctx->co_cap ? ctx->co_cap * 2 : 16;
+			struct aura_coroutine **c = (struct aura_coroutine **)realloc(ctx->co, cap * sizeof(*c));
+			if (c == NULL)
+				raise_error(ctx, "Out of memory");
+			ctx->co = c;
+			ctx->co_cap = cap;
+		}
+		co = (struct aura_coroutine *)malloc(sizeof(*co) + size * AURA_SLOTSIZE);
+		if (co == NULL)
+			raise_error(ctx, "Out of memory");
+		memset(co, 0, sizeof(*co));
+		co->id = slot;
+		co->th.size = size;
+		AURA_SLOTINIT(co->th.type, co->th.v, co + 1, size);
+		co->th.loop = co->loop;
+		ctx->co[slot] = co;
+		++ctx->co_n;
+	}
+	co->status = CO_SUSPENDED;
+	co->resumer = -1;
+	co->active = slot;
+	co->wait = 0;
+	co->th.top = 0;
+	co->th.stackframe = 0;
+	co->th.ci_n = 0;
+	co->th.loop_n = 0;
+	return slot;
+}
+
+static struct aura_coroutine *
+getcoroutine(struct aura_context *ctx, int id) {
+	int slot = id & 0xffff;
+	if (slot == 0 || slot >= ctx->co_n)
+		return NULL;
+	struct aura_coroutine *co = ctx->co[slot];
+	if (co->id != id || co->status == CO_DEAD)
+		return NULL;
+	return co;
+}
+
+// Create a coroutine evaluating the list body (in a new frame), returns its handle
+static int
+coroutine_create(struct aura_context *ctx, int t, union aura_var body) {
+	if (t != AURA_TLIST && t != AURA_TDLIST)
+		raise_error(ctx, "Coroutine need a list");
+	int slot = newcoroutine(ctx, AURA_COSTACKSIZE);
+	struct aura_thread *self = &ctx->co[ctx->current]->th;
+	save_thread(ctx, self);
+	load_thread(ctx, &ctx->co[slot]->th);
+	push_eval(ctx, t, body, 1);
+	save_thread(ctx, &ctx->co[slot]->th);
+	load_thread(ctx, self);
+	return ctx->co[slot]->id;
+}
+
+int
+aura_newcoroutine(struct aura_context *ctx, const char *word) {
+	int id = auraW_index(&ctx->words, word, strlen(word));
+	if (id < 0)
+		raise_error(ctx, "Too many words");
+	struct aura_word *w = &ctx->words.w[id];
+	union aura_var body;
+	if (w->func == cfunc_evalslist) {
+		union {
+			void *ud;
+			struct slist_arg arg;
+		} u;
+		u.ud = w->u.ud;
+		body.slist.offset = u.arg.offset;
+		body.slist.size = u.arg.size;
+		body.slist.prog = u.arg.prog;
+		return coroutine_create(ctx, AURA_TLIST, body);
+	} else if (w->func == cfunc_evaldlist) {
+		body.dlist.offset = w->u.id[0];
+		body.dlist.size = w->u.id[1];
+		return coroutine_create(ctx, AURA_TDLIST, body);
+	}
+	raise_error(ctx, "Coroutine need a word defined by a list");
+	return -1;
+}
+
+/*
+	Run a coroutine from the host for at most budget instructions (no limit if budget <= 0).
+	Returns AURA_YIELD if it yields or runs out of budget, AURA_SUSPEND if it waits for
+	an async function, AURA_OK when it's finished.
+ */
+int
+aura_stepcoroutine(struct aura_context *ctx, int id, int budget) {
+	struct aura_coroutine *co = getcoroutine(ctx, id);
+	int slot = id & 0xffff;
+	int target = slot;
+	if (co == NULL || co->status == CO_RUNNING) {
+		raise_error(ctx, "Cannot resume coroutine");
+		return AURA_OK;
+	}
+	if (co->wait)
+		return AURA_SUSPEND;
+	if (co->status == CO_NORMAL) {
+		// the last step ended inside a coroutine it resumed
+		if (co->resumer >= 0) {
+			raise_error(ctx, "Cannot resume coroutine");
+			return AURA_OK;
+		}
+		target = co->active;
+	} else {
+		co->status = CO_RUNNING;
+		co->resumer = -1;
+	}
+	int host = ctx->current;
+	ctx->stepping = host;
+	coroutine_switch(ctx, target);
+	int r = execute(ctx, budget);
+	int active = ctx->current;
+	coroutine_switch(ctx, host);
+	if (r == EXEC_DONE)
+		return AURA_OK;
+	if (active == slot) {
+		co->status = CO_SUSPENDED;
+	} else {
+		co->active = active;
+	}
+	return exec_status(r);
+}
+
+void
+aura_closecoroutine(struct aura_context *ctx, int id) {
+	struct aura_coroutine *co = getcoroutine(ctx, id);
+	if (co == NULL)
+		return;
+	if (co->status != CO_SUSPENDED)
+		raise_error(ctx, "Cannot close running coroutine");
+	coroutine_kill(ctx, id & 0xffff);
+}
+
+/*
+	Suspend the running chain of coroutines until aura_complete.
+	The token is the handle of the chain root, 0 for the main thread.
+ */
+static struct aura_coroutine *
+suspend(struct aura_context *ctx) {
+	int slot = ctx->current;
+	while (ctx->co[slot]->resumer >= 0)
+		slot = ctx->co[slot]->resumer;
+	struct aura_coroutine *root = ctx->co[slot];
+	root->wait = 1;
+	root->active = ctx->current;
+	ctx->interrupt = INTERRUPT_SUSPEND;
+	return root;
+}
+
+// Push the result onto the suspended coroutine, the host resumes it by aura_resume (token 0) or aura_stepcoroutine
+void
+aura_complete(struct aura_context *ctx, int token, int result) {
+	struct aura_coroutine *root = (token == 0) ? ctx->co[0] : getcoroutine(ctx, token);
+	if (root == NULL || !root->wait) {
+		raise_error(ctx, "Invalid token");
+		return;
+	}
+	root->wait = 0;
+	int slot = root->active;
+	if (slot == ctx->current) {
+		if (!auraS_checkstack(&ctx->stack, 1))
+			raise_error(ctx, "Stack overflow");
+		auraS_pushint(&ctx->stack, result);
+	} else {
+		struct aura_thread *th = &ctx->co[slot]->th;
+		if (th->top >= th->size)
+			raise_error(ctx, "Stack overflow");
+		union aura_var v;
+		v.d = result;
+		AURA_SLOTSET(th->type, th->v, th->top, AURA_TINT, v);
+		++th->top;
+	}
+}
+
+/*
+	An array value refers to an array of the host without copying, nth, set, length, map, filter
+	and fold work on it. The host owns the memory, the id is valid until aura_freearray, the values left
+	with a freed id raise an error instead of reading the next array of the slot.
+ */
+int
+aura_newarray(struct aura_context *ctx, void *ptr, int type, int n) {
+	if (ptr == NULL || n < 0 || type < AURA_INT32 || type > AURA_FLOAT64)
+		raise_error(ctx, "Invalid array");
+	int id = ctx->udata_free;
+	if (id >= 0) {
+		ctx->udata_free = ctx->udata[id].n;
+	} else {
+		if (ctx->udata_n >= 1 << ARRAY_SLOTBITS)
+			raise_error(ctx, "Too many arrays");
+		if (ctx->udata_n >= ctx->udata_cap) {
+			int cap = ctx->udata_cap ? ctx->udata_cap * 2 : 16;
+			struct aura_userdata *u = (struct aura_userdata *)realloc(ctx->udata, cap * sizeof(*u));
+			if (u == NULL)
+				raise_error(ctx, "Out of memory");
+			ctx->udata = u;
+			ctx->udata_cap = cap;
+		}
+		id = ctx->udata_n++;
+		ctx->udata[id].gen = 0;
+	}
+	struct aura_userdata *u = &ctx->udata[id];
+	u->ptr = ptr;
+	u->type = type;
+	u->n = n;
+	new_epoch(ctx);
+	return u->gen << ARRAY_SLOTBITS | id;
+}
+
+void
+aura_pusharray(struct aura_context *ctx, int id) {
+	getarray(ctx, id);
+	if (!auraS_checkstack(&ctx->stack, 1))
+		raise_error(ctx, "Stack overflow");
+	union aura_var v;
+	v.d = id;
+	auraS_pushvar(&ctx->stack, AURA_TARRAY, v);
+}
+
+void
+aura_freearray(struct aura_context *ctx, int id) {
+	struct aura_userdata *u = getarray(ctx, id);
+	u->ptr = NULL;
+	u->n = ctx->udata_free;
+	u->gen = (u->gen + 1) & 0x7fff;
+	ctx->udata_free = ARRAY_SLOT(id);
+	new_epoch(ctx);
+}
+
+// Push a new list of n numbers converted from a host array
+void
+aura_tolist(struct aura_context *ctx, const void *ptr, int type, int n) {
+	if (type < AURA_INT32 || type > AURA_FLOAT64)
+		raise_error(ctx, "Invalid array");
+	union aura_var list = new_dlist(ctx, n);
+	struct aura_userdata u = { (void *)ptr, type, n, 0 };
+	int i;
+	for (i=0;i<n;i++) {
+		union aura_var v;
+		int t = array_get(&u, i, &v);
+		AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, list.dlist.offset + i, t, v);
+	}
+	if (!auraS_checkstack(&ctx->stack, 1))
+		raise_error(ctx, "Stack overflow");
+	auraS_pushdlist(&ctx->stack, list.dlist.offset, list.dlist.size);
+}
+
+// Copy at most n numbers of the list at idx into a host array, returns the number of elements copied
+int
+aura_fromlist(struct aura_context *ctx, int idx, void *ptr, int type, int n) {
+	if (type < AURA_INT32 || type > AURA_FLOAT64)
+		raise_error(ctx, "Invalid array");
+	union aura_var list;
+	int t = auraS_get(&ctx->stack, idx, &list);
+	if (t != AURA_TLIST && t != AURA_TDLIST && t != AURA_TARRAY)
+		raise_error(ctx, "Need a list");
+	int sz = list_size(ctx, t, list);
+	if (sz < n)
+		n = sz;
+	struct aura_userdata u = { ptr, type, n, 0 };
+	int i;
+	for (i=0;i<n;i++) {
+		union aura_var v;
+		int vt = list_get(ctx, t, list, i, &v);
+		if (!array_set(&u, i, vt, v))
+			raise_error(ctx, "Need a number");
+	}
+	return n;
+}
+
+static void *
+get_scratch(struct aura_context *ctx, int sz) {
+	if (sz > ctx->scratch_sz) {
+		void *p = realloc(ctx->scratch, sz);
+		if (p == NULL)
+			raise_error(ctx, "Out of memory");
+		ctx->scratch = p;
+		ctx->scratch_sz = sz;
+	}
+	return ctx->scratch;
+}
+
+/*
+	Batch execution. A word made of straight-line code (numbers, locals and the inline arithmetic)
+	runs AURA_LANES rows at once : each value of the stack or a local is a register of all the rows,
+	and the operators are the kernels of avector.c. The type of a register is the same in all the rows
+	because the columns are typed. Any other instruction, a division by zero or a type error,
+	reruns the rows one by one through the interpreter, which behaves (and raises) as usual.
+ */
+struct lane_reg {
+	int t;	// AURA_TINT, AURA_TFLOAT, or AURA_TBOOLEAN as int 0/1
+	union {
+		int32_t d[AURA_LANES];
+		float f[AURA_LANES];
+	} u;
+};
+
+struct lane_state {
+	int sp;
+	int local_n;
+	uint8_t local_id[AURA_LANELOCALS];
+	struct lane_reg stack[AURA_LANESTACK];
+	struct lane_reg local[AURA_LANELOCALS];
+};
+
+static inline union aura_var
+column_get(const struct aura_column *c, int i, int *t) {
+	union aura_var v;
+	switch (c->type) {
+	case AURA_INT32:
+		*t = AURA_TINT;
+		v.d = ((const int32_t *)c->ptr)[i];
+		break;
+	case AURA_FLOAT32:
+		*t = AURA_TFLOAT;
+		v.f = ((const float *)c->ptr)[i];
+		break;
+	default:
+		*t = AURA_TFLOAT;
+		v.f = (float)((const double *)c->ptr)[i];
+		break;
+	}
+	return v;
+}
+
+// Only the straight-line code with bound inline arithmetic runs in lanes
+static int
+lane_code(struct aura_context *ctx, int pc) {
+	for (;;) {
+		const struct aura_ins *ins = &ctx->code.ins[pc++];
+		switch (ins->op) {
+		case OP_PUSH:
+			if (ins->t != AURA_TINT && ins->t != AURA_TFLOAT)
+				return 0;
+			break;
+		case OP_LOCAL:
+		case OP_SETLOCAL:
+			break;
+		case OP_RET:
+			return 1;
+		default:
+			if (ins->op < OP_ADD || ins->op > OP_NE || math_op(ctx, ins->u.call.word) != ins->op)
+				return 0;
+			break;
+		}
+	}
+}
+
+static void
+lane_tofloat(struct lane_reg *r, int k) {
+	if (r->t == AURA_TINT) {
+		int i;
+		for (i=0;i<k;i++)
+			r->u.f[i] = (float)r->u.d[i];
+		r->t = AURA_TFLOAT;
+	}
+}
+
+// a = a op b, returns 0 to fall back
+static int
+lane_math(int op, struct lane_reg *a, struct lane_reg *b, int k) {
+	static const uint8_t vop[] = { AURA_VADD, AURA_VSUB, AURA_VMUL, AURA_VDIV,
+		AURA_VGT, AURA_VLT, AURA_VGE, AURA_VLE, AURA_VEQ, AURA_VEQ };
+	if (a->t == AURA_TBOOLEAN || b->t == AURA_TBOOLEAN)
+		return 0;
+	int v = vop[op - OP_ADD];
+	int ok;
+	if (a->t == AURA_TINT && b->t == AURA_TINT) {
+		ok = auraV_bini(v, a->u.d, b->u.d, a->u.d, k);
+	} else {
+		lane_tofloat(a, k);
+		lane_tofloat(b, k);
+		if (op >= OP_GT) {
+			int32_t r[AURA_LANES];
+			auraV_binf(v, a->u.f, b->u.f, r, k);
+			memcpy(a->u.d, r, k * sizeof(int32_t));
+			ok = 1;
+		} else {
+			ok = auraV_binf(v, a->u.f, b->u.f, a->u.f, k);
+		}
+	}
+	if (op >= OP_GT) {
+		a->t = AURA_TBOOLEAN;
+		if (op == OP_NE) {
+			int i;
+			for (i=0;i<k;i++)
+				a->u.d[i] = !a->u.d[i];
+		}
+	}
+	return ok;
+}
+
+static struct lane_reg *
+lane_local(struct lane_state *L, int id, int create) {
+	int i;
+	for (i=0;i<L->local_n;i++) {
+		if (L->local_id[i] == id)
+			return &L->local[i];
+	}
+	if (!create || L->local_n >= AURA_LANELOCALS)
+		return NULL;
+	L->local_id[L->local_n] = id;
+	return &L->local[L->local_n++];
+}
+
+// Run rows [row, row+k) in lock-step, returns 0 to fall back
+static int
+lane_run(struct aura_context *ctx, struct lane_state *L, int pc, const struct aura_column *in, int nin,
+	const struct aura_column *out, int nout, int row, int k) {
+	int i, j;
+	if (nin > AURA_LANESTACK)
+		return 0;
+	L->local_n = 0;
+	for (j=0;j<nin;j++) {
+		struct lane_reg *r = &L->stack[j];
+		for (i=0;i<k;i++) {
+			union aura_var v = column_get(&in[j], row + i, &r->t);
+			r->u.d[i] = v.d;
+		}
+	}
+	L->sp = nin;
+	for (;;) {
+		const struct aura_ins *ins = &ctx->code.ins[pc++];
+		struct lane_reg *r;
+		switch (ins->op) {
+		case OP_PUSH:
+			if (L->sp >= AURA_LANESTACK)
+				return 0;
+			r = &L->stack[L->sp++];
+			r->t = ins->t;
+			for (i=0;i<k;i++)
+				r->u.d[i] = ins->u.v.d;
+			break;
+		case OP_LOCAL:
+			r = lane_local(L, ins->u.word, 0);
+			if (r == NULL || L->sp >= AURA_LANESTACK)
+				return 0;
+			L->stack[L->sp].t = r->t;
+			memcpy(L->stack[L->sp++].u.d, r->u.d, k * sizeof(int32_t));
+			break;
+		case OP_SETLOCAL: {
+			int n;
+			for (n=0;n<4 && ins->u.local[n] != AURA_INVALIDLOCAL;n++);
+			if (L->sp < n)
+				return 0;
+			L->sp -= n;
+			for (j=0;j<n;j++) {
+				r = lane_local(L, ins->u.local[j], 1);
+				if (r == NULL)
+					return 0;
+				r->t = L->stack[L->sp + j].t;
+				memcpy(r->u.d, L->stack[L->sp + j].u.d, k * sizeof(int32_t));
+			}
+			break;
+		}
+		case OP_RET:
+			if (L->sp < nout)
+				return 0;
+			for (j=0;j<nout;j++) {
+				struct aura_userdata u = { out[j].ptr, out[j].type, 0, 0 };
+				r = &L->stack[L->sp - nout + j];
+				int t = r->t == AURA_TFLOAT ? AURA_TFLOAT : AURA_TINT;
+				for (i=0;i<k;i++) {
+					union aura_var v;
+					v.d = r->u.d[i];
+					array_set(&u, row + i, t, v);
+				}
+			}
+			return 1;
+		default:
+			if (L->sp < 2 || !lane_math(ins->op, &L->stack[L->sp-2], &L->stack[L->sp-1], k))
+				return 0;
+			--L->sp;
+			break;
+		}
+	}
+}
+
+static void
+batch_row(struct aura_context *ctx, int word, const struct aura_column *in, int nin,
+	const struct aura_column *out, int nout, int row) {
+	ctx->stack.top = 0;
+	ctx->stack.list_n = 0;
+	int j;
+	if (!auraS_checkstack(&ctx->stack, nin))
+		raise_error(ctx, "Stack overflow");
+	for (j=0;j<nin;j++) {
+		int t;
+		union aura_var v = column_get(&in[j], row, &t);
+		auraS_pushvar(&ctx->stack, t, v);
+	}
+	call_word(ctx, word, 0);
+	if (execute(ctx, 0) != EXEC_DONE)
+		raise_error(ctx, "Batch word can't yield");
+	if (!auraS_checkstack(&ctx->stack, -nout))
+		raise_error(ctx, "Stack empty");
+	for (j=0;j<nout;j++) {
+		struct aura_userdata u = { out[j].ptr, out[j].type, 0, 0 };
+		union aura_var v;
+		int t = auraS_get(&ctx->stack, j - nout, &v);
+		if (t == AURA_TTRUE || t == AURA_TFALSE) {
+			v.d = t == AURA_TTRUE;
+			t = AURA_TINT;
+		}
+		if (!array_set(&u, row, t, v))
+			raise_error(ctx, "Batch output must be a number");
+	}
+	ctx->stack.top = 0;
+}
+
+int
+aura_runbatch(struct aura_context *ctx, const char *word, const struct aura_column *in, int nin, const struct aura_column *out, int nout, int rows) {
+	if (ctx->ci_n != 0 || ctx->current != 0)
+		raise_error(ctx, "Batch while running");
+	int j;
+	for (j=0;j<nin+nout;j++) {
+		int type = j < nin ? in[j].type : out[j-nin].type;
+		if (type < AURA_INT32 || type > AURA_FLOAT64)
+			raise_error(ctx, "Invalid column");
+	}
+	int id = auraW_index(&ctx->words, word, strlen(word));
+	if (id < 0)
+		raise_error(ctx, "Too many words");
+	struct aura_binding b;
+	bind_word(ctx, id, &b);
+	struct lane_state *L = NULL;
+	if (b.func == cfunc_evalslist && lane_code(ctx, b.u.code.pc))
+		L = (struct lane_state *)get_scratch(ctx, sizeof(struct lane_state));
+	int lanes = 0;
+	int row, i;
+	for (row=0;row<rows;row+=AURA_LANES) {
+		int k = rows - row < AURA_LANES ? rows - row : AURA_LANES;
+		if (L && lane_run(ctx, L, b.u.code.pc, in, nin, out, nout, row, k)) {
+			lanes += k;
+			continue;
+		}
+		for (i=0;i<k;i++)
+			batch_row(ctx, id, in, nin, out, nout, row + i);
+	}
+	ctx->stack.list_n = 0;
+	return lanes;
+}
+
+#ifdef AURA_PROFILE
+
+int
+aura_profile(struct aura_context *ctx, int enable) {
+	if (!enable) {
+		if (ctx->prof) {
+			free(ctx->prof);
+			ctx->prof = NULL;
+			// inline again
+			flush_code(ctx);
+		}
+		return 1;
+	}
+	if (ctx->prof == NULL) {
+		ctx->prof = (struct aura_profiler *)malloc(sizeof(struct aura_profiler));
+		if (ctx->prof == NULL)
+			raise_error(ctx, "Out of memory");
+	}
+	memset(ctx->prof, 0, sizeof(struct aura_profiler));
+	// recompile without the inlined words and the typed fast calls
+	flush_code(ctx);
+	// the running calls started before the reset
+	int i;
+	for (i=0;i<ctx->ci_n;i++)
+		ctx->ci[i].prof.word = -1;
+	return 1;
+}
+
+static int
+prof_bycalls(const void *a, const void *b) {
+	unsigned x = ((const struct aura_profentry *)a)->calls;
+	unsigned y = ((const struct aura_profentry *)b)->calls;
+	return (x < y) - (x > y);
+}
+
+static int
+prof_byself(const void *a, const void *b) {
+	unsigned long long x = ((const struct aura_profentry *)a)->self;
+	unsigned long long y = ((const struct aura_profentry *)b)->self;
+	return (x < y) - (x > y);
+}
+
+static int
+prof_bytotal(const void *a, const void *b) {
+	unsigned long long x = ((const struct aura_profentry *)a)->total;
+	unsigned long long y = ((const struct aura_profentry *)b)->total;
+	return (x < y) - (x > y);
+}
+
+static int
+prof_byalloc(const void *a, const void *b) {
+	unsigned long long x = ((const struct aura_profentry *)a)->alloc;
+	unsigned long long y = ((const struct aura_profentry *)b)->alloc;
+	return (x < y) - (x > y);
+}
+
+int
+aura_profreport(struct aura_context *ctx, struct aura_profentry *e, int n, int key) {
+	static int (*const cmp[])(const void *, const void *) = { prof_bycalls, prof_byself, prof_bytotal, prof_byalloc };
+	struct aura_profiler *p = ctx->prof;
+	if (p == NULL)
+		return 0;
+	if (key < AURA_PROFCALLS || key > AURA_PROFALLOC)
+		raise_error(ctx, "Invalid profile key");
+	struct aura_profentry *all = (struct aura_profentry *)get_scratch(ctx, ctx->words.n * sizeof(*all));
+	int i;
+	int count = 0;
+	for (i=0;i<ctx->words.n;i++) {
+		const struct prof_word *w = &p->word[i];
+		if (w->calls == 0)
+			continue;
+		struct aura_profentry *r = &all[count++];
+		r->name = auraW_name(&ctx->words, i);
+		r->calls = w->calls;
+		r->self = w->self;
+		r->total = w->total;
+		r->alloc = w->alloc;
+	}
+	qsort(all, count, sizeof(*all), cmp[key]);
+	memcpy(e, all, (count < n ? count : n) * sizeof(*e));
+	return count;
+}
+
+int
+aura_profflame(struct aura_context *ctx, char *buf, int sz) {
+	struct aura_profiler *p = ctx->prof;
+	if (sz > 0)
+		buf[0] = 0;
+	if (p == NULL)
+		return 0;
+	int len = 0;
+	int i;
+	for (i=0;i<p->node_n;i++) {
+		if (p->node[i].self == 0)
+			continue;
+		int path[AURA_PROFDEPTH];
+		int depth = 0;
+		int id;
+		for (id = i; id >= 0 && depth < AURA_PROFDEPTH; id = p->node[id].parent)
+			path[depth++] = p->node[id].word;
+		while (--depth >= 0) {
+			len += snprintf(len < sz ? buf + len : NULL, len < sz ? sz - len : 0, "%s%c",
+				auraW_name(&ctx->words, path[depth]), depth > 0 ? ';' : ' ');
+		}
+		len += snprintf(len < sz ? buf + len : NULL, len < sz ? sz - len : 0, "%llu\n", (unsigned long long)p->node[i].self);
+	}
+	return len;
+}
+
+#else
+
+int
+aura_profile(struct aura_context *ctx, int enable) {
+	return 0;
+}
+
+int
+aura_profreport(struct aura_context *ctx, struct aura_profentry *e, int n, int key) {
+	return 0;
+}
+
+int
+aura_profflame(struct aura_context *ctx, char *buf, int sz) {
+	if (sz > 0)
+		buf[0] = 0;
+	return 0;
+}
+
+#endif
+
+/*
+	A host buffer takes an unused prog slot, the strings refer to it without copying.
+	The host owns the bytes, they must stay valid while any string refers to them.
+	ptr NULL releases the slot.
+ */
+void
+aura_setbuffer(struct aura_context *ctx, int id, const char *ptr, int sz) {
+	if (id < 0 || id >= AURA_MAXPROG || ctx->prog[id])
+		raise_error(ctx, "Invalid buffer id");
+	if (sz < 0 || sz > (1 << 20))
+		raise_error(ctx, "Buffer too large");
+	ctx->buffer[id].ptr = ptr;
+	ctx->buffer[id].sz = ptr ? sz : 0;
+	new_epoch(ctx);
+}
+
+void
+aura_pushstring(struct aura_context *ctx, int id, int offset, int sz) {
+	if (id < 0 || id >= AURA_MAXPROG || ctx->buffer[id].ptr == NULL)
+		raise_error(ctx, "Invalid buffer id");
+	if (offset < 0 || sz < 0 || sz > 0xffff || offset + sz > ctx->buffer[id].sz)
+		raise_error(ctx, "Invalid string");
+	if (!auraS_checkstack(&ctx->stack, 1))
+		raise_error(ctx, "Stack overflow");
+	auraS_pushstring(&ctx->stack, id, offset, sz);
+}
+
+// arg async
+static void
+cfunc_async(struct aura_context *ctx, void *ud) {
+	struct aura_async *a = &ctx->async[(intptr_t)ud];
+	union aura_var arg;
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	if (auraS_get(&ctx->stack, -1, &arg) != AURA_TINT)
+		aura_error(ctx, "Async function need an integer");
+	auraS_pop(&ctx->stack, 1);
+	struct aura_coroutine *root = suspend(ctx);
+	a->func(ctx, root->id, arg.d, a->ud);
+	if (!root->wait) {
+		// completed synchronously
+		ctx->interrupt = 0;
+	}
+}
+
+void
+aura_registerasync(struct aura_context *ctx, const char *name, aura_asyncfunction func, void *ud) {
+	if (ctx->async_n >= ctx->async_cap) {
+		int cap = ctx->async_cap ? ctx->async_cap * 2 : 16;
+		struct aura_async *a = (struct aura_async *)realloc(ctx->async, cap * sizeof(*a));
+		if (a == NULL)
+			raise_error(ctx, "Out of memory");
+		ctx->async = a;
+		ctx->async_cap = cap;
+	}
+	int index = ctx->async_n++;
+	ctx->async[index].func = func;
+	ctx->async[index].ud = ud;
+	aura_register(ctx, name, cfunc_async, (void *)(intptr_t)index);
+}
+
+/*
+	Typed functions are called through a cast to their prototype. The prototypes are the combinations
+	of int32_t and float of up to AURA_MAXCARGS arguments, selected by the shape of the signature.
+ */
+#define CARG_I(k) a[k].d
+#define CARG_F(k) a[k].f
+#define CTYPE_SHAPES(X, R) \
+	X(R, 0x1, (void), ()) \
+	X(R, 0x2, (int32_t), (CARG_I(0))) \
+	X(R, 0x3, (float), (CARG_F(0))) \
+	X(R, 0x4, (int32_t, int32_t), (CARG_I(0), CARG_I(1))) \
+	X(R, 0x5, (float, int32_t), (CARG_F(0), CARG_I(1))) \
+	X(R, 0x6, (int32_t, float), (CARG_I(0), CARG_F(1))) \
+	X(R, 0x7, (float, float), (CARG_F(0), CARG_F(1))) \
+	X(R, 0x8, (int32_t, int32_t, int32_t), (CARG_I(0), CARG_I(1), CARG_I(2))) \
+	X(R, 0x9, (float, int32_t, int32_t), (CARG_F(0), CARG_I(1), CARG_I(2))) \
+	X(R, 0xa, (int32_t, float, int32_t), (CARG_I(0), CARG_F(1), CARG_I(2))) \
+	X(R, 0xb, (float, float, int32_t), (CARG_F(0), CARG_F(1), CARG_I(2))) \
+	X(R, 0xc, (int32_t, int32_t, float), (CARG_I(0), CARG_I(1), CARG_F(2))) \
+	X(R, 0xd, (float, int32_t, float), (CARG_F(0), CARG_I(1), CARG_F(2))) \
+	X(R, 0xe, (int32_t, float, float), (CARG_I(0), CARG_F(1), CARG_F(2))) \
+	X(R, 0xf, (float, float, float), (CARG_F(0), CARG_F(1), CARG_F(2)))
+#define CTYPE_CALL(R, shape, proto, args) case shape: return ((R (*) proto)f) args;
+#define CTYPE_CALLVOID(R, shape, proto, args) case shape: ((R (*) proto)f) args; break;
+
+static int32_t
+ccall_int(aura_typedfunction f, int shape, const union aura_var *a) {
+	switch (shape) {
+	CTYPE_SHAPES(CTYPE_CALL, int32_t)
+	default: return 0;
+	}
+}
+
+static float
+ccall_float(aura_typedfunction f, int shape, const union aura_var *a) {
+	switch (shape) {
+	CTYPE_SHAPES(CTYPE_CALL, float)
+	default: return 0;
+	}
+}
+
+static void
+ccall_void(aura_typedfunction f, int shape, const union aura_var *a) {
+	switch (shape) {
+	CTYPE_SHAPES(CTYPE_CALLVOID, void)
+	default: break;
+	}
+}
+
+// Returns the type of the result, or -1 for none
+static int
+ctype_call(const struct aura_ctype *c, const union aura_var *a, union aura_var *r) {
+	switch (c->ret) {
+	case CTYPE_INT:
+		r->d = ccall_int(c->func, c->shape, a);
+		return AURA_TINT;
+	case CTYPE_FLOAT:
+		r->f = ccall_float(c->func, c->shape, a);
+		return AURA_TFLOAT;
+	case CTYPE_BOOL:
+		r->d = 0;
+		return ccall_int(c->func, c->shape, a) ? AURA_TTRUE : AURA_TFALSE;
+	default:
+		ccall_void(c->func, c->shape, a);
+		return -1;
+	}
+}
+
+// The only type check of the typed calls, ints are converted for float arguments
+static void
+ctype_check(struct aura_context *ctx, const struct aura_ctype *c, const int *t, union aura_var *a) {
+	int i;
+	for (i=0;i<c->n;i++) {
+		switch (c->arg[i]) {
+		case CTYPE_INT:
+			if (t[i] != AURA_TINT)
+				aura_error(ctx, "Need an integer");
+			break;
+		case CTYPE_FLOAT:
+			if (t[i] == AURA_TINT)
+				a[i].f = (float)a[i].d;
+			else if (t[i] != AURA_TFLOAT)
+				aura_error(ctx, "Need a number");
+			break;
+		default:
+			if (t[i] != AURA_TTRUE && t[i] != AURA_TFALSE)
+				aura_error(ctx, "Need a boolean");
+			a[i].d = t[i] == AURA_TTRUE;
+			break;
+		}
+	}
+}
+
+static void
+cfunc_typed(struct aura_context *ctx, void *ud) {
+	const struct aura_ctype *c = &ctx->ctype[(intptr_t)ud];
+	int n = c->n;
+	if (!auraS_checkstack(&ctx->stack, -n))
+		aura_error(ctx, "Stack empty");
+	union aura_var a[AURA_MAXCARGS];
+	int t[AURA_MAXCARGS];
+	int i;
+	for (i=0;i<n;i++)
+		t[i] = auraS_get(&ctx->stack, i - n, &a[i]);
+	ctype_check(ctx, c, t, a);
+	auraS_pop(&ctx->stack, n);
+	union aura_var r;
+	int rt = ctype_call(c, a, &r);
+	if (rt >= 0) {
+		if (!auraS_checkstack(&ctx->stack, 1))
+			aura_error(ctx, "Stack overflow");
+		auraS_pushvar(&ctx->stack, rt, r);
+	}
+}
+
+static int
+ctype_name(const char **sig) {
+	static const char *name[] = { "int", "float", "bool" };
+	const char *p = *sig;
+	int i;
+	for (i=0;i<3;i++) {
+		int sz = strlen(name[i]);
+		if (strncmp(p, name[i], sz) == 0 && (p[sz] == ' ' || p[sz] == ')')) {
+			*sig = p + sz;
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void
+parse_signature(struct aura_context *ctx, const char *sig, struct aura_ctype *c) {
+	const char *p = sig;
+	int results = 0;
+	int ret = CTYPE_VOID;
+	c->n = 0;
+	if (*p++ != '(')
+		raise_error(ctx, "Invalid signature");
+	for (;;) {
+		while (*p == ' ')
+			++p;
+		if (*p == ')')
+			break;
+		if (p[0] == '-' && p[1] == '-' && (p[2] == ' ' || p[2] == ')')) {
+			if (results)
+				raise_error(ctx, "Invalid signature");
+			results = 1;
+			p += 2;
+			continue;
+		}
+		int t = ctype_name(&p);
+		if (t < 0)
+			raise_error(ctx, "Invalid signature");
+		if (results) {
+			if (ret != CTYPE_VOID)
+				raise_error(ctx, "Typed function returns one value");
+			ret = t;
+		} else {
+			if (c->n >= AURA_MAXCARGS)
+				raise_error(ctx, "Too many arguments");
+			c->arg[c->n++] = t;
+		}
+	}
+	if (p[1] != 0)
+		raise_error(ctx, "Invalid signature");
+	c->ret = ret;
+	c->shape = 1 << c->n;
+	c->key = 0;
+	int i;
+	for (i=0;i<c->n;i++) {
+		static const uint8_t stype[] = { AURA_TINT, AURA_TFLOAT, AURA_TINT };
+		if (c->arg[i] == CTYPE_FLOAT)
+			c->shape |= 1 << i;
+		// a bool argument never matches, it is converted by ctype_check
+		c->key |= (uint32_t)(c->arg[i] == CTYPE_BOOL ? 0xff : stype[c->arg[i]]) << (i * 8);
+	}
+}
+
+void
+aura_registertyped(struct aura_context *ctx, const char *name, const char *sig, aura_typedfunction func) {
+	struct aura_ctype c;
+	parse_signature(ctx, sig, &c);
+	c.func = func;
+	if (ctx->ctype_n >= ctx->ctype_cap) {
+		int cap = ctx->ctype_cap ? ctx->ctype_cap * 2 : 16;
+		struct aura_ctype *t = (struct aura_ctype *)realloc(ctx->ctype, cap * sizeof(*t));
+		if (t == NULL)
+			raise_error(ctx, "Out of memory");
+		ctx->ctype = t;
+		ctx->ctype_cap = cap;
+	}
+	int index = ctx->ctype_n++;
+	ctx->ctype[index] = c;
+	aura_register(ctx, name, cfunc_typed, (void *)(intptr_t)index);
+}
+
+void
+aura_error(struct aura_context *ctx, const char *msg) {
+	raise_error(ctx, msg);
+}
+
+static void
+cfunc_eval(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	union aura_var var;
+	int t = auraS_get(&ctx->stack, -1, &var);
+	auraS_pop(&ctx->stack, 1);
+	push_eval(ctx, t, var, 1);
+}
+
+static void
+cfunc_upeval(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	union aura_var var;
+	int t = auraS_get(&ctx->stack, -1, &var);
+	auraS_pop(&ctx->stack, 1);
+	push_eval(ctx, t, var, 0);
+}
+
+static void
+push_boolean(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, 1))
+		aura_error(ctx, "Stack overflow");
+	auraS_pushboolean(&ctx->stack, ud != NULL);
+}
+
+static void
+cfunc_evalslist(struct aura_context *ctx, void *ud) {
+	union {
+		void *ud;
+		struct slist_arg arg;
+	} u;
+	u.ud = ud;
+	assert(u.arg.prog >=0 && u.arg.prog < AURA_MAXPROG);
+	union aura_var list;
+	list.slist.offset = u.arg.offset;
+	list.slist.size = u.arg.size;
+	list.slist.prog = u.arg.prog;
+	push_eval(ctx, AURA_TLIST, list, 1);
+}
+
+static void
+cfunc_evaldlist(struct aura_context *ctx, void *ud) {
+	union {
+		void *ud;
+		int id[2];
+	} u;
+	u.ud = ud;
+	union aura_var list;
+	list.dlist.offset = u.id[0];
+	list.dlist.size = u.id[1];
+	push_eval(ctx, AURA_TDLIST, list, 1);
+}
+
+// a dict captured by def
+static void
+cfunc_evaldict(struct aura_context *ctx, void *ud) {
+	union {
+		void *ud;
+		int id[2];
+	} u;
+	u.ud = ud;
+	if (!auraS_checkstack(&ctx->stack, 1))
+		aura_error(ctx, "Stack overflow");
+	union aura_var dict;
+	dict.dlist.offset = u.id[0];
+	dict.dlist.size = u.id[1];
+	auraS_pushvar(&ctx->stack, AURA_TDICT, dict);
+}
+
+static void
+cfunc_def(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	union aura_var word, list;
+	if (auraS_get(&ctx->stack, -1, &word) != AURA_TWORDREF)
+		aura_error(ctx, "def need wordref");
+	assert(word.word >=0 && word.word < AURA_MAXWORDS);
+	struct aura_word * w = &ctx->words.w[word.word];
+	if (w->func != NULL)
+		aura_error(ctx, "Already defined");
+	int t = auraS_get(&ctx->stack, -2, &list);
+	if (t == AURA_TLIST) {
+		union {
+			void *ud;
+			struct slist_arg arg;
+		} u;
+		u.arg.offset = list.slist.offset;
+		u.arg.size = list.slist.size;
+		u.arg.prog = list.slist.prog;
+		w->func = cfunc_evalslist;
+		w->u.ud = u.ud;
+	} else {
+		if (t != AURA_TDLIST && t != AURA_TDICT) {
+			aura_error(ctx, "def need list");
+		}
+		auraS_pop(&ctx->stack, 1);
+		if (!auraS_persistence(&ctx->stack)) {
+			aura_error(ctx, "def can't persistence list");
+		}
+		auraS_get(&ctx->stack, -1, &list);
+		w->func = t == AURA_TDICT ? cfunc_evaldict : cfunc_evaldlist;
+		w->u.id[0] = list.dlist.offset;
+		w->u.id[1] = list.dlist.size;
+		auraS_pushword(&ctx->stack, word.word);
+	}
+	rebind_word(ctx, word.word);
+	auraS_pop(&ctx->stack, 2);
+}
+
+/*
+	Memo words cache the result of their body by the values of the arguments, in a direct-mapped table.
+	Only numbers and booleans are cached : other arguments or results always run the body.
+	A recursive call may take the slot of a pending call, the stamp tells the pending call to give it up.
+ */
+static inline int
+memo_key(int t) {
+	return t == AURA_TINT || t == AURA_TFLOAT || t == AURA_TTRUE || t == AURA_TFALSE;
+}
+
+static int
+memo_args(struct aura_context *ctx, int n, uint8_t *t, int32_t *v) {
+	int i;
+	for (i=0;i<n;i++) {
+		union aura_var a;
+		int at = auraS_get(&ctx->stack, i - n, &a);
+		if (!memo_key(at))
+			return 0;
+		t[i] = at;
+		v[i] = (at == AURA_TINT || at == AURA_TFLOAT) ? a.d : 0;
+	}
+	return 1;
+}
+
+static uint32_t
+memo_hash(int n, const uint8_t *t, const int32_t *v) {
+	uint32_t h = 2166136261u;
+	int i;
+	for (i=0;i<n;i++) {
+		h = (h ^ t[i]) * 16777619u;
+		h = (h ^ (uint32_t)v[i]) * 16777619u;
+	}
+	return h ^ (h >> 15);
+}
+
+static void
+cfunc_memo(struct aura_context *ctx, void *ud) {
+	int id = (int)(intptr_t)ud;
+	struct aura_memo *m = &ctx->memo[id];
+	int n = m->n;
+	if (!auraS_checkstack(&ctx->stack, -n))
+		aura_error(ctx, "Stack empty");
+	uint8_t t[AURA_MEMOARGS];
+	int32_t v[AURA_MEMOARGS];
+	if (!memo_args(ctx, n, t, v)) {
+		++m->misses;
+		push_eval(ctx, AURA_TLIST, m->body, 1);
+		return;
+	}
+	if (m->slot == NULL) {
+		m->slot = (struct aura_memoslot *)calloc(AURA_MEMOSIZE, sizeof(struct aura_memoslot));
+		if (m->slot == NULL)
+			aura_error(ctx, "Out of memory");
+	}
+	int index = memo_hash(n, t, v) & (AURA_MEMOSIZE - 1);
+	struct aura_memoslot *slot = &m->slot[index];
+	if (slot->ready && memcmp(slot->t, t, n) == 0 && memcmp(slot->v, v, n * sizeof(int32_t)) == 0) {
+		++m->hits;
+		union aura_var r;
+		r.d = slot->v[n];
+		if (!auraS_checkstack(&ctx->stack, 1 - n))
+			aura_error(ctx, "Stack overflow");
+		auraS_pop(&ctx->stack, n);
+		auraS_pushvar(&ctx->stack, slot->t[n], r);
+		return;
+	}
+	++m->misses;
+	if (++m->stamp == 0)
+		m->stamp = 1;
+	slot->stamp = m->stamp;
+	slot->ready = 0;
+	memcpy(slot->t, t, n);
+	memcpy(slot->v, v, n * sizeof(int32_t));
+	struct aura_callinfo *ci = newcall(ctx, CI_MEMO);
+	ci->n = id;
+	ci->pc = ctx->stack.top - n + 1;
+	ci->v[0].d = index;
+	ci->v[1].d = m->stamp;
+	push_eval(ctx, AURA_TLIST, m->body, 1);
+}
+
+static void
+memo_return(struct aura_context *ctx, struct aura_callinfo *ci) {
+	struct aura_memo *m = &ctx->memo[ci->n];
+	struct aura_memoslot *slot = m->slot ? &m->slot[ci->v[0].d] : NULL;
+	if (slot && slot->stamp == (uint32_t)ci->v[1].d && ctx->stack.top == ci->pc) {
+		union aura_var r;
+		int t = auraS_get(&ctx->stack, -1, &r);
+		if (memo_key(t)) {
+			slot->t[m->n] = t;
+			slot->v[m->n] = (t == AURA_TINT || t == AURA_TFLOAT) ? r.d : 0;
+			slot->ready = 1;
+		}
+	}
+	endcall(ctx);
+}
+
+// [body] n 'word defmemo
+static void
+cfunc_defmemo(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -3))
+		aura_error(ctx, "Stack empty");
+	union aura_var word, n, list;
+	if (auraS_get(&ctx->stack, -1, &word) != AURA_TWORDREF)
+		aura_error(ctx, "defmemo need wordref");
+	if (auraS_get(&ctx->stack, -2, &n) != AURA_TINT || n.d < 0 || n.d > AURA_MEMOARGS)
+		aura_error(ctx, "defmemo need 0-4 arguments");
+	if (auraS_get(&ctx->stack, -3, &list) != AURA_TLIST)
+		aura_error(ctx, "defmemo need list");
+	if (ctx->words.w[word.word].func != NULL)
+		aura_error(ctx, "Already defined");
+	new_memo(ctx, word.word, n.d, list);
+	auraS_pop(&ctx->stack, 3);
+}
+
+static void
+new_memo(struct aura_context *ctx, int word, int n, union aura_var body) {
+	if (ctx->memo_n >= ctx->memo_cap) {
+		int cap = ctx->memo_cap ? ctx->memo_cap * 2 : 16;
+		struct aura_memo *m = (struct aura_memo *)realloc(ctx->memo, cap * sizeof(*m));
+		if (m == NULL)
+			aura_error(ctx, "Out of memory");
+		ctx->memo = m;
+		ctx->memo_cap = cap;
+	}
+	int id = ctx->memo_n++;
+	struct aura_memo *m = &ctx->memo[id];
+	memset(m, 0, sizeof(*m));
+	m->n = n;
+	m->body = body;
+	struct aura_word *w = &ctx->words.w[word];
+	w->func = cfunc_memo;
+	w->u.ud = (void *)(intptr_t)id;
+	rebind_word(ctx, word);
+}
+
+static struct aura_memo *
+check_memo(struct aura_context *ctx) {
+	union aura_var word;
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	if (auraS_get(&ctx->stack, -1, &word) != AURA_TWORDREF)
+		aura_error(ctx, "Need wordref");
+	const struct aura_word *w = &ctx->words.w[word.word];
+	if (w->func != cfunc_memo)
+		aura_error(ctx, "Not a memo word");
+	auraS_pop(&ctx->stack, 1);
+	return &ctx->memo[(intptr_t)w->u.ud];
+}
+
+// 'word memo-clear
+static void
+cfunc_memoclear(struct aura_context *ctx, void *ud) {
+	struct aura_memo *m = check_memo(ctx);
+	if (m->slot)
+		memset(m->slot, 0, AURA_MEMOSIZE * sizeof(struct aura_memoslot));
+	m->hits = 0;
+	m->misses = 0;
+	// the workers drop their caches too
+	new_epoch(ctx);
+}
+
+// 'word memo-stats -> hits misses
+static void
+cfunc_memostats(struct aura_context *ctx, void *ud) {
+	struct aura_memo *m = check_memo(ctx);
+	if (!auraS_checkstack(&ctx->stack, 2))
+		aura_error(ctx, "Stack overflow");
+	auraS_pushint(&ctx->stack, (int)m->hits);
+	auraS_pushint(&ctx->stack, (int)m->misses);
+}
+
+static inline float
+tofloat(struct aura_context *ctx, int t, union aura_var v) {
+	if (t == AURA_TFLOAT)
+		return v.f;
+	else if (t == AURA_TINT)
+		return (float)v.d;
+	else {
+		aura_error(ctx, "Need a number");
+		return 0;
+	}
+}
+
+static void
+cfunc_basicmath(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	union aura_var left, right;
+	int lt = auraS_get(&ctx->stack, -2, &left);
+	int rt = auraS_get(&ctx->stack, -1, &right);
+	int op = (int)(intptr_t)ud;
+	auraS_pop(&ctx->stack, 2);
+	if (lt == AURA_TINT && rt == AURA_TINT) {
+		int lv = left.d;
+		int rv = right.d;
+		switch (op) {
+		case '+':
+			auraS_pushint(&ctx->stack, lv + rv);
+			break;
+		case '-':
+			auraS_pushint(&ctx->stack, lv - rv);
+			break;
+		case '*':
+			auraS_pushint(&ctx->stack, lv * rv);
+			break;
+		case '/':
+			if (rv == 0)
+				aura_error(ctx, "Divide zero");
+			auraS_pushint(&ctx->stack, lv / rv);
+			break;
+		case '>':
+			auraS_pushboolean(&ctx->stack, lv > rv);
+			break;
+		case '<':
+			auraS_pushboolean(&ctx->stack, lv < rv);
+			break;
+		case '}':	// >=
+			auraS_pushboolean(&ctx->stack, lv >= rv);
+			break;
+		case '{':	// <=
+			auraS_pushboolean(&ctx->stack, lv <= rv);
+			break;
+		}
+	} else {
+		float lv = tofloat(ctx, lt, left);
+		float rv = tofloat(ctx, rt, right);
+		switch (op) {
+		case '+':
+			auraS_pushfloat(&ctx->stack, lv + rv);
+			break;
+		case '-':
+			auraS_pushfloat(&ctx->stack, lv - rv);
+			break;
+		case '*':
+			auraS_pushfloat(&ctx->stack, lv * rv);
+			break;
+		case '/':
+			if (rv == 0)
+				aura_error(ctx, "Divide zero");
+			auraS_pushfloat(&ctx->stack, lv / rv);
+			break;
+		case '>':
+			auraS_pushboolean(&ctx->stack, lv > rv);
+			break;
+		case '<':
+			auraS_pushboolean(&ctx->stack, lv < rv);
+			break;
+		case '}':	// >=
+			auraS_pushboolean(&ctx->stack, lv >= rv);
+			break;
+		case '{':	// <=
+			auraS_pushboolean(&ctx->stack, lv <= rv);
+			break;
+		}
+	}
+}
+
+static int
+compare(struct aura_context *ctx) {
+	union aura_var left, right;
+	int lt = auraS_get(&ctx->stack, -2, &left);
+	int rt = auraS_get(&ctx->stack, -1, &right);
+	auraS_pop(&ctx->stack, 2);
+	if (lt == rt) {
+		switch (lt) {
+		case AURA_TSTRING:
+			return auraS_samestring(&ctx->stack, left, right);
+		case AURA_TLIST:
+			return left.slist.prog == right.slist.prog &&
+				left.slist.offset == right.slist.offset &&
+				left.slist.size == right.slist.size;
+		case AURA_TDLIST:
+		case AURA_TDICT:
+		case AURA_TSEQ:
+			return left.dlist.offset == right.dlist.offset &&
+				left.dlist.size == right.dlist.size;
+		case AURA_TWORD:
+		case AURA_TWORDREF:
+			return left.word == right.word;
+		case AURA_TINT:
+		case AURA_TCOROUTINE:
+		case AURA_TARRAY:
+			return left.d == right.d;
+		case AURA_TFLOAT:
+			return left.f == right.f;
+		case AURA_TTRUE:
+		case AURA_TFALSE:
+			return 1;
+		default:
+			return 0;
+		}
+	} else if (lt == AURA_TINT && rt == AURA_TFLOAT) {
+		return (float)left.d == right.f;
+	} else if (lt == AURA_TFLOAT && rt == AURA_TINT) {
+		return left.f == (float)right.d;
+	} else {
+		return 0;
+	}
+}
+
+static void
+cfunc_compare(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	int r = (ud != NULL) ^ compare(ctx);
+	auraS_pushboolean(&ctx->stack, r);
+}
+
+static struct aura_callinfo *
+newcontinuation(struct aura_context *ctx, int kind, int n) {
+	struct aura_callinfo *ci = newcall(ctx, kind);
+	int i;
+	for (i=0;i<n;i++) {
+		ci->t[i] = auraS_get(&ctx->stack, i - n, &ci->v[i]);
+	}
+	auraS_pop(&ctx->stack, n);
+	return ci;
+}
+
+static void
+cfunc_if(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	union aura_var cond;
+	int t = auraS_get(&ctx->stack, -2, &cond);
+	newcontinuation(ctx, CI_IF, 1);
+	auraS_pop(&ctx->stack, 1);
+	push_eval(ctx, t, cond, 0);
+}
+
+static void
+cfunc_ifelse(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -3))
+		aura_error(ctx, "Stack empty");
+	union aura_var cond;
+	int t = auraS_get(&ctx->stack, -3, &cond);
+	newcontinuation(ctx, CI_IFELSE, 2);
+	auraS_pop(&ctx->stack, 1);
+	push_eval(ctx, t, cond, 0);
+}
+
+static void
+cfunc_while(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	newcontinuation(ctx, CI_WHILE, 2);
+}
+
+static void
+cfunc_times(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	union aura_var n;
+	if (auraS_get(&ctx->stack, -2, &n) != AURA_TINT)
+		aura_error(ctx, "times need an integer");
+	struct aura_callinfo *ci = newcontinuation(ctx, CI_TIMES, 1);
+	auraS_pop(&ctx->stack, 1);
+	ci->pc = n.d;
+}
+
+static void
+cfunc_for(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -3))
+		aura_error(ctx, "Stack empty");
+	union aura_var from, to;
+	int ft = auraS_get(&ctx->stack, -3, &from);
+	if (auraS_get(&ctx->stack, -2, &to) != AURA_TINT || ft != AURA_TINT)
+		aura_error(ctx, "for need integers");
+	struct aura_callinfo *ci = newcontinuation(ctx, CI_FOR, 1);
+	auraS_pop(&ctx->stack, 2);
+	ci->pc = from.d;
+	ci->v[1].d = to.d;
+}
+
+static int
+check_list(struct aura_context *ctx, int idx, union aura_var *list) {
+	int t = auraS_get(&ctx->stack, idx, list);
+	if (t != AURA_TLIST && t != AURA_TDLIST && t != AURA_TARRAY)
+		aura_error(ctx, "Need a list");
+	return t;
+}
+
+static int
+check_index(struct aura_context *ctx, int idx, int n) {
+	union aura_var i;
+	if (auraS_get(&ctx->stack, idx, &i) != AURA_TINT)
+		aura_error(ctx, "Need an integer index");
+	if (i.d < 0 || i.d > n)
+		aura_error(ctx, "Index out of range");
+	return i.d;
+}
+
+// n newlist -> list of n false
+static void
+cfunc_newlist(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	union aura_var n;
+	if (auraS_get(&ctx->stack, -1, &n) != AURA_TINT || n.d < 0)
+		aura_error(ctx, "newlist need a size");
+	auraS_pop(&ctx->stack, 1);
+	union aura_var list = new_dlist(ctx, n.d);
+	auraS_pushdlist(&ctx->stack, list.dlist.offset, list.dlist.size);
+}
+
+// list/dict/string length -> n
+static void
+cfunc_length(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	union aura_var v;
+	int n;
+	switch (auraS_type(&ctx->stack, -1)) {
+	case AURA_TDICT:
+		n = auraS_dictlen(&ctx->stack, -1);
+		break;
+	case AURA_TSTRING:
+		auraS_get(&ctx->stack, -1, &v);
+		n = v.str.size;
+		break;
+	default:
+		n = list_size(ctx, check_list(ctx, -1, &v), v);
+		break;
+	}
+	auraS_pop(&ctx->stack, 1);
+	auraS_pushint(&ctx->stack, n);
+}
+
+// list index nth -> value
+static void
+cfunc_nth(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	union aura_var list;
+	int t = check_list(ctx, -2, &list);
+	int n = list_size(ctx, t, list);
+	int i = check_index(ctx, -1, n);
+	if (i == n)
+		aura_error(ctx, "Index out of range");
+	auraS_pop(&ctx->stack, 2);
+	push_element(ctx, t, list, i);
+}
+
+// list index value set -> list
+static void
+cfunc_set(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -3))
+		aura_error(ctx, "Stack empty");
+	union aura_var list;
+	int t = check_list(ctx, -3, &list);
+	if (t == AURA_TLIST)
+		aura_error(ctx, "set need a dlist");
+	int n = list_size(ctx, t, list);
+	int i = check_index(ctx, -2, n);
+	if (i == n)
+		aura_error(ctx, "Index out of range");
+	if (t == AURA_TARRAY) {
+		union aura_var v;
+		int vt = auraS_get(&ctx->stack, -1, &v);
+		if (!array_set(getarray(ctx, list.d), i, vt, v))
+			aura_error(ctx, "Need a number");
+		auraS_pop(&ctx->stack, 2);
+		return;
+	}
+	auraS_setn(&ctx->stack, -3, i);
+	auraS_pop(&ctx->stack, 1);
+}
+
+// list from to slice -> list, a view of [from, to) shares the elements, so does a substring
+static void
+cfunc_slice(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -3))
+		aura_error(ctx, "Stack empty");
+	union aura_var list;
+	if (auraS_get(&ctx->stack, -3, &list) == AURA_TSTRING) {
+		int from = check_index(ctx, -2, list.str.size);
+		int to = check_index(ctx, -1, list.str.size);
+		if (to < from)
+			aura_error(ctx, "Invalid slice");
+		auraS_pop(&ctx->stack, 3);
+		auraS_pushstring(&ctx->stack, list.str.buffer, list.str.offset + from, to - from);
+		return;
+	}
+	int t = check_list(ctx, -3, &list);
+	if (t == AURA_TARRAY)
+		aura_error(ctx, "slice need a list");
+	int n = list_size(ctx, t, list);
+	int from = check_index(ctx, -2, n);
+	int to = check_index(ctx, -1, n);
+	if (to < from)
+		aura_error(ctx, "Invalid slice");
+	auraS_pop(&ctx->stack, 3);
+	if (t == AURA_TDLIST) {
+		auraS_pushdlist(&ctx->stack, list.dlist.offset + from, to - from);
+	} else {
+		auraS_pushlist(&ctx->stack, list.slist.offset + from, to - from, list.slist.prog);
+	}
+}
+
+// list value append -> list, amortized O(1) for the list growing in a loop
+static void
+cfunc_append(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	union aura_var list;
+	int t = check_list(ctx, -2, &list);
+	if (t != AURA_TDLIST) {
+		list = copy_dlist(ctx, t, list, list_size(ctx, t, list));
+		AURA_SLOTSET(ctx->stack.type, ctx->stack.v, ctx->stack.top - 2, AURA_TDLIST, list);
+	}
+	if (!auraS_append(&ctx->stack))
+		aura_error(ctx, "Out of list memory");
+}
+
+static void
+check_dict(struct aura_context *ctx, int idx, int key) {
+	if (auraS_type(&ctx->stack, idx) != AURA_TDICT)
+		aura_error(ctx, "Need a dict");
+	int t = auraS_type(&ctx->stack, key);
+	if (t != AURA_TINT && t != AURA_TWORDREF && t != AURA_TSTRING)
+		aura_error(ctx, "Invalid key");
+}
+
+// n newdict -> dict for n keys
+static void
+cfunc_newdict(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	union aura_var n;
+	if (auraS_get(&ctx->stack, -1, &n) != AURA_TINT || n.d < 0)
+		aura_error(ctx, "newdict need a size");
+	auraS_pop(&ctx->stack, 1);
+	if (!auraS_createdict(&ctx->stack, n.d))
+		aura_error(ctx, "Out of list memory");
+}
+
+// dict key value put -> dict, use the returned dict : it moves when the table grows
+static void
+cfunc_put(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -3))
+		aura_error(ctx, "Stack empty");
+	check_dict(ctx, -3, -2);
+	if (!auraS_dictset(&ctx->stack, -3))
+		aura_error(ctx, "Out of list memory");
+}
+
+// dict key get -> value, false if the key doesn't exist
+static void
+cfunc_get(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	check_dict(ctx, -2, -1);
+	if (auraS_dictget(&ctx->stack, -2)) {
+		auraS_copy(&ctx->stack, -1, -2);
+		auraS_pop(&ctx->stack, 1);
+	} else {
+		auraS_pop(&ctx->stack, 1);
+		auraS_pushboolean(&ctx->stack, 0);
+	}
+}
+
+// dict key has -> boolean
+static void
+cfunc_has(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	check_dict(ctx, -2, -1);
+	int r = auraS_dictget(&ctx->stack, -2);
+	auraS_pop(&ctx->stack, r + 1);
+	auraS_pushboolean(&ctx->stack, r);
+}
+
+// dict key del -> dict
+static void
+cfunc_del(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	check_dict(ctx, -2, -1);
+	if (auraS_dictdel(&ctx->stack, -2) < 0)
+		aura_error(ctx, "Out of list memory");
+}
+
+// dict keys -> list, dict values -> list
+static void
+cfunc_keys(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	if (auraS_type(&ctx->stack, -1) != AURA_TDICT)
+		aura_error(ctx, "Need a dict");
+	if (!auraS_checkstack(&ctx->stack, 2))
+		aura_error(ctx, "Stack overflow");
+	int n = auraS_dictlen(&ctx->stack, -1);
+	union aura_var list = new_dlist(ctx, n);
+	int i = 0;
+	int iter = 0;
+	int value = ud != NULL;
+	while ((iter = auraS_dictnext(&ctx->stack, -1, iter))) {
+		int top = ctx->stack.top -= 2;
+		AURA_SLOTCOPY(ctx->stack.list_t, ctx->stack.list, list.dlist.offset + i, ctx->stack.type, ctx->stack.v, top + value);
+		++i;
+	}
+	auraS_pop(&ctx->stack, 1);
+	auraS_pushdlist(&ctx->stack, list.dlist.offset, list.dlist.size);
+}
+
+static union aura_var
+check_string(struct aura_context *ctx, int idx) {
+	union aura_var s;
+	if (auraS_get(&ctx->stack, idx, &s) != AURA_TSTRING)
+		aura_error(ctx, "Need a string");
+	return s;
+}
+
+static int
+string_order(struct aura_context *ctx, union aura_var a, union aura_var b) {
+	int n = a.str.size < b.str.size ? a.str.size : b.str.size;
+	int r = memcmp(auraS_string(&ctx->stack, a), auraS_string(&ctx->stack, b), n);
+	if (r == 0)
+		r = (int)a.str.size - (int)b.str.size;
+	return (r > 0) - (r < 0);
+}
+
+// a b compare -> -1, 0 or 1
+static void
+cfunc_strcompare(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	union aura_var a = check_string(ctx, -2);
+	union aura_var b = check_string(ctx, -1);
+	int r = string_order(ctx, a, b);
+	auraS_pop(&ctx->stack, 2);
+	auraS_pushint(&ctx->stack, r);
+}
+
+// string hash -> int
+static void
+cfunc_hash(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	union aura_var s = check_string(ctx, -1);
+	auraS_pop(&ctx->stack, 1);
+	auraS_pushint(&ctx->stack, (int)auraS_hashstring(auraS_string(&ctx->stack, s), s.str.size));
+}
+
+static int
+find_string(const char *s, int sz, const char *sub, int n) {
+	if (n == 0)
+		return 0;
+	const char *p = s;
+	const char *end = s + sz - n;
+	while (p <= end) {
+		p = (const char *)memchr(p, sub[0], end - p + 1);
+		if (p == NULL)
+			return -1;
+		if (memcmp(p, sub, n) == 0)
+			return p - s;
+		++p;
+	}
+	return -1;
+}
+
+// string sub find -> index, -1 if not found
+static void
+cfunc_find(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	union aura_var s = check_string(ctx, -2);
+	union aura_var sub = check_string(ctx, -1);
+	int r = find_string(auraS_string(&ctx->stack, s), s.str.size, auraS_string(&ctx->stack, sub), sub.str.size);
+	auraS_pop(&ctx->stack, 2);
+	auraS_pushint(&ctx->stack, r);
+}
+
+// string sep split -> list of the substrings, they share the bytes of string
+static void
+cfunc_split(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	union aura_var s = check_string(ctx, -2);
+	union aura_var sep = check_string(ctx, -1);
+	if (sep.str.size == 0)
+		aura_error(ctx, "Empty separator");
+	const char *str = auraS_string(&ctx->stack, s);
+	const char *sepstr = auraS_string(&ctx->stack, sep);
+	int n = 1;
+	int i = 0;
+	int r;
+	while ((r = find_string(str + i, s.str.size - i, sepstr, sep.str.size)) >= 0) {
+		++n;
+		i += r + sep.str.size;
+	}
+	union aura_var list = new_dlist(ctx, n);
+	union aura_var part = s;
+	i = 0;
+	for (n=0;;n++) {
+		r = find_string(str + i, s.str.size - i, sepstr, sep.str.size);
+		part.str.offset = s.str.offset + i;
+		part.str.size = r < 0 ? s.str.size - i : r;
+		AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, list.dlist.offset + n, AURA_TSTRING, part);
+		if (r < 0)
+			break;
+		i += r + sep.str.size;
+	}
+	auraS_pop(&ctx->stack, 2);
+	auraS_pushdlist(&ctx->stack, list.dlist.offset, list.dlist.size);
+}
+
+/*
+	Vector words run the kernels of avector.c over lists and arrays of numbers.
+	The operands are int32 if all the elements are integers, float32 otherwise, a number is broadcast.
+	An array of the same element type is used in place, the others are converted into the scratch.
+ */
+struct vector_arg {
+	int t;
+	int n;	// -1 for a number
+	int isfloat;
+	union aura_var v;
+};
+
+static void
+vector_arg(struct aura_context *ctx, int idx, struct vector_arg *a) {
+	a->t = auraS_get(&ctx->stack, idx, &a->v);
+	switch (a->t) {
+	case AURA_TINT:
+	case AURA_TFLOAT:
+		a->n = -1;
+		a->isfloat = a->t == AURA_TFLOAT;
+		return;
+	case AURA_TARRAY:
+		a->n = list_size(ctx, a->t, a->v);
+		a->isfloat = getarray(ctx, a->v.d)->type != AURA_INT32;
+		return;
+	}
+	a->t = check_list(ctx, idx, &a->v);
+	a->n = list_size(ctx, a->t, a->v);
+	a->isfloat = 0;
+	int i;
+	for (i=0;i<a->n;i++) {
+		union aura_var v;
+		int t = list_get(ctx, a->t, a->v, i, &v);
+		if (t == AURA_TFLOAT)
+			a->isfloat = 1;
+		else if (t != AURA_TINT)
+			aura_error(ctx, "Need numbers");
+	}
+}
+
+static inline void *
+vector_scratch(struct aura_context *ctx, int n) {
+	return get_scratch(ctx, (n + 1) * 3 * sizeof(int32_t));
+}
+
+// part is the index of the scratch array (0-2)
+static const void *
+vector_data(struct aura_context *ctx, struct vector_arg *a, int isfloat, int n, int part) {
+	if (a->t == AURA_TARRAY) {
+		const struct aura_userdata *u = getarray(ctx, a->v.d);
+		if (u->type == (isfloat ? AURA_FLOAT32 : AURA_INT32))
+			return u->ptr;
+	}
+	union {
+		float *f;
+		int32_t *d;
+	} p;
+	p.d = (int32_t *)ctx->scratch + part * n;
+	int i;
+	for (i=0;i<n;i++) {
+		union aura_var v = a->v;
+		int t = a->n < 0 ? a->t : list_get(ctx, a->t, a->v, i, &v);
+		if (isfloat)
+			p.f[i] = t == AURA_TINT ? (float)v.d : v.f;
+		else
+			p.d[i] = v.d;
+	}
+	return p.d;
+}
+
+static void
+vector_result(struct aura_context *ctx, const void *r, int type, int n) {
+	union aura_var list = new_dlist(ctx, n);
+	int i;
+	for (i=0;i<n;i++) {
+		union aura_var v;
+		int t = type;
+		if (type == AURA_TFLOAT) {
+			v.f = ((const float *)r)[i];
+		} else {
+			v.d = ((const int32_t *)r)[i];
+			if (type == AURA_TBOOLEAN)
+				t = v.d ? AURA_TTRUE : AURA_TFALSE;
+		}
+		AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, list.dlist.offset + i, t, v);
+	}
+	auraS_pushdlist(&ctx->stack, list.dlist.offset, list.dlist.size);
+}
+
+// The size of two operands, at least one is a vector
+static int
+vector_size(struct aura_context *ctx, struct vector_arg *a, struct vector_arg *b) {
+	if (a->n < 0 && b->n < 0)
+		aura_error(ctx, "Need a vector");
+	if (a->n >= 0 && b->n >= 0 && a->n != b->n)
+		aura_error(ctx, "Vector size mismatch");
+	return a->n >= 0 ? a->n : b->n;
+}
+
+// a b v+ -> list, and v- v* v/ v< v> v<= v>= v==
+static void
+cfunc_vbinop(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	int op = (int)(intptr_t)ud;
+	struct vector_arg a, b;
+	vector_arg(ctx, -2, &a);
+	vector_arg(ctx, -1, &b);
+	int n = vector_size(ctx, &a, &b);
+	int isfloat = a.isfloat || b.isfloat;
+	vector_scratch(ctx, n);
+	const void *x = vector_data(ctx, &a, isfloat, n, 0);
+	const void *y = vector_data(ctx, &b, isfloat, n, 1);
+	int32_t *r = (int32_t *)ctx->scratch + 2 * n;
+	int ok = isfloat ? auraV_binf(op, x, y, r, n) : auraV_bini(op, x, y, r, n);
+	if (!ok)
+		aura_error(ctx, "Divide zero");
+	auraS_pop(&ctx->stack, 2);
+	vector_result(ctx, r, op >= AURA_VLT ? AURA_TBOOLEAN : (isfloat ? AURA_TFLOAT : AURA_TINT), n);
+}
+
+// v vsum -> number, and vmin vmax
+static void
+cfunc_vreduce(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	int op = (int)(intptr_t)ud;
+	struct vector_arg a;
+	vector_arg(ctx, -1, &a);
+	if (a.n < 0)
+		aura_error(ctx, "Need a vector");
+	if (a.n == 0 && op != AURA_VSUM)
+		aura_error(ctx, "Empty vector");
+	vector_scratch(ctx, a.n);
+	const void *x = vector_data(ctx, &a, a.isfloat, a.n, 0);
+	auraS_pop(&ctx->stack, 1);
+	if (a.isfloat)
+		auraS_pushfloat(&ctx->stack, auraV_reducef(op, x, NULL, a.n));
+	else
+		auraS_pushint(&ctx->stack, auraV_reducei(op, x, NULL, a.n));
+}
+
+// a b vdot -> number
+static void
+cfunc_vdot(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	struct vector_arg a, b;
+	vector_arg(ctx, -2, &a);
+	vector_arg(ctx, -1, &b);
+	int n = vector_size(ctx, &a, &b);
+	int isfloat = a.isfloat || b.isfloat;
+	vector_scratch(ctx, n);
+	const void *x = vector_data(ctx, &a, isfloat, n, 0);
+	const void *y = vector_data(ctx, &b, isfloat, n, 1);
+	auraS_pop(&ctx->stack, 2);
+	if (isfloat)
+		auraS_pushfloat(&ctx->stack, auraV_reducef(AURA_VDOT, x, y, n));
+	else
+		auraS_pushint(&ctx->stack, auraV_reducei(AURA_VDOT, x, y, n));
+}
+
+// a x y vaxpy -> list of a * x + y
+static void
+cfunc_vaxpy(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -3))
+		aura_error(ctx, "Stack empty");
+	struct vector_arg a, x, y;
+	vector_arg(ctx, -3, &a);
+	vector_arg(ctx, -2, &x);
+	vector_arg(ctx, -1, &y);
+	if (a.n >= 0)
+		aura_error(ctx, "vaxpy need a number");
+	int n = vector_size(ctx, &x, &y);
+	int isfloat = a.isfloat || x.isfloat || y.isfloat;
+	vector_scratch(ctx, n);
+	const void *px = vector_data(ctx, &x, isfloat, n, 0);
+	const void *py = vector_data(ctx, &y, isfloat, n, 1);
+	int32_t *r = (int32_t *)ctx->scratch + 2 * n;
+	memcpy(r, py, n * sizeof(int32_t));
+	if (isfloat)
+		auraV_axpyf(a.isfloat ? a.v.f : (float)a.v.d, px, (float *)r, n);
+	else
+		auraV_axpyi(a.v.d, px, r, n);
+	auraS_pop(&ctx->stack, 3);
+	vector_result(ctx, r, isfloat ? AURA_TFLOAT : AURA_TINT, n);
+}
+
+/*
+	The order of the sort words : numbers by value, strings by bytes, other values by type then identity.
+	sort and sort-by work in place on a dlist (a static list is copied first), and on an array.
+	Number keys use the radix sort of avector.c, the others an introsort. Both are stable.
+ */
+static int
+value_order(struct aura_context *ctx, int at, union aura_var a, int bt, union aura_var b) {
+	if (at == AURA_TINT && bt == AURA_TINT)
+		return (a.d > b.d) - (a.d < b.d);
+	if ((at == AURA_TINT || at == AURA_TFLOAT) && (bt == AURA_TINT || bt == AURA_TFLOAT)) {
+		double x = at == AURA_TINT ? (double)a.d : (double)a.f;
+		double y = bt == AURA_TINT ? (double)b.d : (double)b.f;
+		return (x > y) - (x < y);
 	}
-	if (prog == NULL) {
-		raise_error(ctx, "No prog");
+	if (at != bt)
+		return at < bt ? -1 : 1;
+	switch (at) {
+	case AURA_TSTRING:
+		return string_order(ctx, a, b);
+	case AURA_TLIST:
+		if (a.slist.prog != b.slist.prog)
+			return a.slist.prog < b.slist.prog ? -1 : 1;
+		if (a.slist.offset != b.slist.offset)
+			return a.slist.offset < b.slist.offset ? -1 : 1;
+		return (a.slist.size > b.slist.size) - (a.slist.size < b.slist.size);
+	case AURA_TDLIST:
+	case AURA_TDICT:
+	case AURA_TSEQ:
+		if (a.dlist.offset != b.dlist.offset)
+			return a.dlist.offset < b.dlist.offset ? -1 : 1;
+		return (a.dlist.size > b.dlist.size) - (a.dlist.size < b.dlist.size);
+	case AURA_TWORD:
+	case AURA_TWORDREF:
+		return (a.word > b.word) - (a.word < b.word);
+	case AURA_TCOROUTINE:
+	case AURA_TARRAY:
+		return (a.d > b.d) - (a.d < b.d);
+	default:
+		return 0;
 	}
-	ctx->stack.list_n = 0;
-	ctx->stackframe = 0;
-	newframe(ctx);
+}
 
-	int t = prog[0].index.type;
-	if (t != AURA_TLIST) {
-		raise_error(ctx, "Invalid code");
+struct sort_item {
+	uint8_t kt;
+	uint8_t t;
+	int pos;	// the original position, ties keep it
+	union aura_var k;
+	union aura_var v;
+};
+
+static inline int
+item_order(struct aura_context *ctx, const struct sort_item *a, const struct sort_item *b) {
+	int r = value_order(ctx, a->kt, a->k, b->kt, b->k);
+	return r ? r : a->pos - b->pos;
+}
+
+static void
+heap_sift(struct aura_context *ctx, struct sort_item *a, int i, int n) {
+	struct sort_item tmp = a[i];
+	for (;;) {
+		int c = i * 2 + 1;
+		if (c >= n)
+			break;
+		if (c + 1 < n && item_order(ctx, &a[c], &a[c+1]) < 0)
+			++c;
+		if (item_order(ctx, &tmp, &a[c]) >= 0)
+			break;
+		a[i] = a[c];
+		i = c;
 	}
-	const union list_node * node = &prog[prog[0].index.offset];
+	a[i] = tmp;
+}
 
-	execute_slist(ctx, prog, node->list.offset, node->list.n,  progid);
+static void
+introsort(struct aura_context *ctx, struct sort_item *a, int n, int depth) {
+	while (n > 16) {
+		struct sort_item tmp;
+		if (depth-- == 0) {
+			// heapsort
+			int i;
+			for (i=n/2-1;i>=0;i--)
+				heap_sift(ctx, a, i, n);
+			for (i=n-1;i>0;i--) {
+				tmp = a[0]; a[0] = a[i]; a[i] = tmp;
+				heap_sift(ctx, a, 0, i);
+			}
+			return;
+		}
+		// median of three at mid, the partition never empties a side
+		int mid = (n - 1) / 2;
+		if (item_order(ctx, &a[mid], &a[0]) < 0) {
+			tmp = a[mid]; a[mid] = a[0]; a[0] = tmp;
+		}
+		if (item_order(ctx, &a[n-1], &a[mid]) < 0) {
+			tmp = a[mid]; a[mid] = a[n-1]; a[n-1] = tmp;
+			if (item_order(ctx, &a[mid], &a[0]) < 0) {
+				tmp = a[mid]; a[mid] = a[0]; a[0] = tmp;
+			}
+		}
+		struct sort_item pivot = a[mid];
+		int i = -1, j = n;
+		for (;;) {
+			do ++i; while (item_order(ctx, &a[i], &pivot) < 0);
+			do --j; while (item_order(ctx, &a[j], &pivot) > 0);
+			if (i >= j)
+				break;
+			tmp = a[i]; a[i] = a[j]; a[j] = tmp;
+		}
+		++j;
+		if (j < n - j) {
+			introsort(ctx, a, j, depth);
+			a += j;
+			n -= j;
+		} else {
+			introsort(ctx, a + j, n - j, depth);
+			n = j;
+		}
+	}
+	int i, j;
+	for (i=1;i<n;i++) {
+		struct sort_item tmp = a[i];
+		for (j=i;j>0 && item_order(ctx, &tmp, &a[j-1]) < 0;j--)
+			a[j] = a[j-1];
+		a[j] = tmp;
+	}
+}
 
-	endframe(ctx);
+// Sort n slots at offset by the keys at key (the slots themselves if key == offset)
+static void
+sort_dlist(struct aura_context *ctx, int offset, int n, int key) {
+	if (n < 2)
+		return;
+	struct sort_item *item = get_scratch(ctx, n * (sizeof(struct sort_item) + 4 * sizeof(uint32_t)));
+	uint32_t *k = (uint32_t *)(item + n);
+	uint32_t *idx = k + n;
+	int i;
+	int kt = -1;
+	for (i=0;i<n;i++) {
+		struct sort_item *it = &item[i];
+		it->t = AURA_SLOTGET(ctx->stack.list_t, ctx->stack.list, offset + i, &it->v);
+		it->kt = AURA_SLOTGET(ctx->stack.list_t, ctx->stack.list, key + i, &it->k);
+		it->pos = i;
+		if (i == 0)
+			kt = it->kt;
+		else if (kt != it->kt)
+			kt = -1;
+	}
+	if (kt == AURA_TINT || kt == AURA_TFLOAT) {
+		for (i=0;i<n;i++) {
+			k[i] = kt == AURA_TINT ? auraV_keyi(item[i].k.d) : auraV_keyf(item[i].k.f);
+			idx[i] = i;
+		}
+		auraV_radixsort(k, idx, idx + n, n);
+	} else {
+		int depth = 0;
+		for (i=n;i>0;i>>=1)
+			depth += 2;
+		introsort(ctx, item, n, depth);
+		for (i=0;i<n;i++)
+			idx[i] = i;
+	}
+	for (i=0;i<n;i++) {
+		const struct sort_item *it = &item[idx[i]];
+		AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, offset + i, it->t, it->v);
+	}
 }
 
-void
-aura_error(struct aura_context *ctx, const char *msg) {
-	raise_error(ctx, msg);
+static int
+double_order(const void *a, const void *b) {
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
 }
 
 static void
-eval(struct aura_context *ctx, union aura_var var, int t) {
-	if (t == AURA_TLIST) {
-		int progid = var.slist.prog;
-		union list_node *prog = ctx->prog[progid];
-		execute_slist(ctx, prog, var.slist.offset, var.slist.size, progid);
+sort_array(struct aura_context *ctx, struct aura_userdata *u) {
+	int n = u->n;
+	if (u->type == AURA_FLOAT64) {
+		qsort(u->ptr, n, sizeof(double), double_order);
+		return;
+	}
+	uint32_t *k = get_scratch(ctx, (n + 1) * 3 * sizeof(uint32_t));
+	int i;
+	if (u->type == AURA_INT32) {
+		int32_t *p = u->ptr;
+		for (i=0;i<n;i++)
+			k[i] = auraV_keyi(p[i]);
+		auraV_radixsort(k, NULL, k + n, n);
+		for (i=0;i<n;i++)
+			p[i] = auraV_fromkeyi(k[i]);
 	} else {
-		if (t != AURA_TDLIST)
-			aura_error(ctx, "Eval need a list");
-		execute_dlist(ctx, var);
+		float *p = u->ptr;
+		for (i=0;i<n;i++)
+			k[i] = auraV_keyf(p[i]);
+		auraV_radixsort(k, NULL, k + n, n);
+		for (i=0;i<n;i++)
+			p[i] = auraV_fromkeyf(k[i]);
 	}
 }
 
+// list sort -> list
 static void
-cfunc_eval(struct aura_context *ctx, void *ud) {
-	union aura_var var;
-	int t = auraS_get(&ctx->stack, -1, &var);
+cfunc_sort(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	union aura_var list;
+	int t = check_list(ctx, -1, &list);
+	if (t == AURA_TARRAY) {
+		sort_array(ctx, getarray(ctx, list.d));
+		return;
+	}
+	if (t == AURA_TLIST)
+		list = copy_dlist(ctx, t, list, list_size(ctx, t, list));
 	auraS_pop(&ctx->stack, 1);
-	newframe(ctx);
-	eval(ctx, var, t);
-	endframe(ctx);
+	sort_dlist(ctx, list.dlist.offset, list.dlist.size, list.dlist.offset);
+	auraS_pushdlist(&ctx->stack, list.dlist.offset, list.dlist.size);
 }
 
+// list [key] sort-by -> list
 static void
-cfunc_upeval(struct aura_context *ctx, void *ud) {
-	union aura_var var;
-	int t = auraS_get(&ctx->stack, -1, &var);
+cfunc_sortby(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	union aura_var list;
+	int t = check_list(ctx, -2, &list);
+	struct aura_callinfo *ci = newcontinuation(ctx, CI_SORTBY, 2);
+	int n = list_size(ctx, t, list);
+	ci->n = n;
+	ci->v[0] = copy_dlist(ctx, t, list, n * 2);
+	ci->t[0] = AURA_TDLIST;
+}
+
+// sorted value binsearch -> the index of the first element not less than value
+static void
+cfunc_binsearch(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	union aura_var list, value;
+	int t = check_list(ctx, -2, &list);
+	int vt = auraS_get(&ctx->stack, -1, &value);
+	int lo = 0, hi = list_size(ctx, t, list);
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		union aura_var v;
+		int et = list_get(ctx, t, list, mid, &v);
+		if (value_order(ctx, et, v, vt, value) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	auraS_pop(&ctx->stack, 2);
+	auraS_pushint(&ctx->stack, lo);
+}
+
+// list unique -> list without the adjacent duplicates
+static void
+cfunc_unique(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	union aura_var list;
+	int t = check_list(ctx, -1, &list);
+	if (t != AURA_TDLIST)
+		list = copy_dlist(ctx, t, list, list_size(ctx, t, list));
+	int n = list.dlist.size;
+	int i, r = 0;
+	union aura_var last, v;
+	int lt = 0;
+	for (i=0;i<n;i++) {
+		int vt = AURA_SLOTGET(ctx->stack.list_t, ctx->stack.list, list.dlist.offset + i, &v);
+		if (i > 0 && lt == vt && value_order(ctx, lt, last, vt, v) == 0)
+			continue;
+		if (r != i)
+			AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, list.dlist.offset + r, vt, v);
+		++r;
+		lt = vt;
+		last = v;
+	}
 	auraS_pop(&ctx->stack, 1);
-	eval(ctx, var, t);
+	auraS_pushdlist(&ctx->stack, list.dlist.offset, r);
+}
+
+/*
+	A sequence is a block of the list heap : the source (a kind and 3 arguments) and the stages (a kind and an argument).
+	The elements are produced one by one while it's consumed by each, fold or collect,
+	map and filter on a sequence only add a stage. The bodies run in the frame of the consumer.
+ */
+#define SEQ_RANGE 0	// from, to, step
+#define SEQ_LIST 1	// list
+#define SEQ_GEN 2	// body, pushes value true, or false at the end
+#define SEQ_MAP 3
+#define SEQ_FILTER 4
+#define SEQ_TAKE 5
+
+#define SEQ_EACH 0
+#define SEQ_FOLD 1
+#define SEQ_COLLECT 2
+
+// the phases of CI_SEQ, 0 .. stages-1 waits for a stage, stages waits for the consumer
+#define SEQ_NEXT -1
+#define SEQ_GENERATED -2
+
+static inline int
+seq_slot(struct aura_context *ctx, int i, union aura_var *v) {
+	return AURA_SLOTGET(ctx->stack.list_t, ctx->stack.list, i, v);
 }
 
 static void
-push_boolean(struct aura_context *ctx, void *ud) {
-	if (!auraS_checkstack(&ctx->stack, 1))
-		aura_error(ctx, "Stack overflow");
-	auraS_pushboolean(&ctx->stack, ud != NULL);
+new_seq(struct aura_context *ctx, int kind, int t, union aura_var a, union aura_var b, union aura_var c) {
+	union aura_var seq = new_dlist(ctx, 4);
+	union aura_var k;
+	k.d = kind;
+	AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, seq.dlist.offset, AURA_TINT, k);
+	AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, seq.dlist.offset + 1, t, a);
+	AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, seq.dlist.offset + 2, AURA_TINT, b);
+	AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, seq.dlist.offset + 3, AURA_TINT, c);
+	auraS_pushvar(&ctx->stack, AURA_TSEQ, seq);
 }
 
-struct slist_arg {
-	uint16_t offset;
-	uint16_t size;
-	int prog;
-};
+static void
+push_range(struct aura_context *ctx, int from, int to) {
+	union aura_var a, b, c;
+	a.d = from;
+	b.d = to;
+	c.d = 1;
+	new_seq(ctx, SEQ_RANGE, AURA_TINT, a, b, c);
+}
 
+// n iota -> 0 .. n-1
 static void
-cfunc_evalslist(struct aura_context *ctx, void *ud) {
-	union {
-		void *ud;
-		struct slist_arg arg;
-	} u;
-	u.ud = ud;
-	int progid = u.arg.prog;
-	assert(progid >=0 && progid < AURA_MAXPROG);
-	const union list_node * node = ctx->prog[progid];
-	int n = u.arg.size;
+cfunc_iota(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	union aura_var n;
+	if (auraS_get(&ctx->stack, -1, &n) != AURA_TINT)
+		aura_error(ctx, "Need an integer");
+	auraS_pop(&ctx->stack, 1);
+	push_range(ctx, 0, n.d - 1);
+}
+
+// from to range -> from .. to, as for
+static void
+cfunc_range(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	union aura_var from, to;
+	if (auraS_get(&ctx->stack, -2, &from) != AURA_TINT)
+		aura_error(ctx, "Need integers");
+	if (auraS_get(&ctx->stack, -1, &to) != AURA_TINT)
+		aura_error(ctx, "Need integers");
+	auraS_pop(&ctx->stack, 2);
+	push_range(ctx, from.d, to.d);
+}
+
+// list lazy -> sequence of the elements
+static void
+cfunc_lazy(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	union aura_var list, zero;
+	int t = check_list(ctx, -1, &list);
+	zero.d = 0;
+	auraS_pop(&ctx->stack, 1);
+	new_seq(ctx, SEQ_LIST, t, list, zero, zero);
+}
+
+// [body] generator -> sequence
+static void
+cfunc_generator(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	union aura_var body, zero;
+	int t = auraS_get(&ctx->stack, -1, &body);
+	zero.d = 0;
+	auraS_pop(&ctx->stack, 1);
+	new_seq(ctx, SEQ_GEN, t, body, zero, zero);
+}
+
+// seq arg -> seq, a copy of the sequence with a new stage
+static void
+seq_stage(struct aura_context *ctx, int kind) {
+	union aura_var seq, arg, k;
+	auraS_get(&ctx->stack, -2, &seq);
+	int t = auraS_get(&ctx->stack, -1, &arg);
+	int n = seq.dlist.size;
+	union aura_var r = new_dlist(ctx, n + 2);
 	int i;
 	for (i=0;i<n;i++) {
-		execute_listword(ctx, node, u.arg.offset+i, progid);
+		AURA_SLOTCOPY(ctx->stack.list_t, ctx->stack.list, r.dlist.offset + i,
+			ctx->stack.list_t, ctx->stack.list, seq.dlist.offset + i);
 	}
+	k.d = kind;
+	AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, r.dlist.offset + n, AURA_TINT, k);
+	AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, r.dlist.offset + n + 1, t, arg);
+	auraS_pop(&ctx->stack, 2);
+	auraS_pushvar(&ctx->stack, AURA_TSEQ, r);
 }
 
+// seq n take -> the first n elements
 static void
-cfunc_evaldlist(struct aura_context *ctx, void *ud) {
-	union {
-		void *ud;
-		int id[2];
-	} u;
-	u.ud = ud;
+cfunc_take(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	if (auraS_type(&ctx->stack, -2) != AURA_TSEQ)
+		aura_error(ctx, "Need a sequence");
+	if (auraS_type(&ctx->stack, -1) != AURA_TINT)
+		aura_error(ctx, "Need an integer");
+	seq_stage(ctx, SEQ_TAKE);
+}
+
+/*
+	The iteration state is a dlist : the sequence, the cursor of the source,
+	and a counter for each stage (used by take).
+ */
+static void
+seq_consume(struct aura_context *ctx, union aura_var seq, int consumer, int bt, union aura_var body) {
+	int nstage = (seq.dlist.size - 4) / 2;
+	union aura_var state = new_dlist(ctx, 2 + nstage);
+	union aura_var kind, v;
+	AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, state.dlist.offset, AURA_TSEQ, seq);
+	seq_slot(ctx, seq.dlist.offset, &kind);
+	if (kind.d == SEQ_RANGE)
+		seq_slot(ctx, seq.dlist.offset + 1, &v);
+	else
+		v.d = 0;
+	AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, state.dlist.offset + 1, AURA_TINT, v);
+	v.d = 0;
+	int i;
+	for (i=0;i<nstage;i++) {
+		AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, state.dlist.offset + 2 + i, AURA_TINT, v);
+	}
+	struct aura_callinfo *ci = newcall(ctx, CI_SEQ);
+	ci->t[0] = AURA_TDLIST;
+	ci->v[0] = state;
+	ci->t[1] = bt;
+	ci->v[1] = body;
+	ci->n = consumer;
+	ci->pc = SEQ_NEXT;
+	seq_resume(ctx, ci);
+}
+
+// Push the next element of the source, returns 0 at the end, -1 if a generator is running
+static int
+seq_next(struct aura_context *ctx, struct aura_callinfo *ci, int seq, int cursor) {
+	union aura_var kind, a, b, c, cur;
+	seq_slot(ctx, seq, &kind);
+	int t = seq_slot(ctx, seq + 1, &a);
+	seq_slot(ctx, seq + 2, &b);
+	seq_slot(ctx, seq + 3, &c);
+	if (seq_slot(ctx, cursor, &cur) != AURA_TINT)
+		return 0;	// the range overflows
+	switch (kind.d) {
+	case SEQ_RANGE: {
+		if (cur.d > b.d)
+			return 0;
+		if (!auraS_checkstack(&ctx->stack, 1))
+			raise_error(ctx, "Stack overflow");
+		auraS_pushint(&ctx->stack, cur.d);
+		int64_t next = (int64_t)cur.d + c.d;
+		if (next > INT32_MAX) {
+			AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, cursor, AURA_TFALSE, cur);
+		} else {
+			cur.d = (int)next;
+			AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, cursor, AURA_TINT, cur);
+		}
+		return 1;
+	}
+	case SEQ_LIST:
+		if (cur.d >= list_size(ctx, t, a))
+			return 0;
+		push_element(ctx, t, a, cur.d++);
+		AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, cursor, AURA_TINT, cur);
+		return 1;
+	default:
+		ci->pc = SEQ_GENERATED;
+		push_eval(ctx, t, a, 0);
+		return -1;
+	}
+}
+
+static void
+seq_resume(struct aura_context *ctx, struct aura_callinfo *ci) {
+	union aura_var state = ci->v[0];
+	union aura_var seq;
+	seq_slot(ctx, state.dlist.offset, &seq);
+	int nstage = (seq.dlist.size - 4) / 2;
+	int phase = ci->pc;
+	for (;;) {
+		int stage = 0;
+		if (phase == nstage) {
+			phase = SEQ_NEXT;	// the consumer returns
+		}
+		if (phase == SEQ_NEXT) {
+			int r = seq_next(ctx, ci, seq.dlist.offset, state.dlist.offset + 1);
+			if (r == 0)
+				break;
+			if (r < 0)
+				return;
+		} else if (phase == SEQ_GENERATED) {
+			if (!pop_condition(ctx))
+				break;
+		} else {
+			// the stage returns
+			union aura_var kind;
+			seq_slot(ctx, seq.dlist.offset + 4 + phase * 2, &kind);
+			if (kind.d == SEQ_FILTER && !pop_condition(ctx)) {
+				auraS_pop(&ctx->stack, 1);
+				phase = SEQ_NEXT;
+				continue;
+			}
+			stage = phase + 1;
+		}
+		for (;stage<nstage;stage++) {
+			union aura_var kind, arg;
+			int slot = seq.dlist.offset + 4 + stage * 2;
+			seq_slot(ctx, slot, &kind);
+			int t = seq_slot(ctx, slot + 1, &arg);
+			if (kind.d == SEQ_TAKE) {
+				union aura_var count;
+				int counter = state.dlist.offset + 2 + stage;
+				seq_slot(ctx, counter, &count);
+				if (count.d >= arg.d) {
+					auraS_pop(&ctx->stack, 1);
+					goto done;
+				}
+				++count.d;
+				AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, counter, AURA_TINT, count);
+				continue;
+			}
+			if (kind.d == SEQ_FILTER) {
+				if (!auraS_checkstack(&ctx->stack, 1))
+					raise_error(ctx, "Stack overflow");
+				auraS_pushvalue(&ctx->stack, -1);
+			}
+			ci->pc = stage;
+			push_eval(ctx, t, arg, 0);
+			return;
+		}
+		if (ci->n == SEQ_COLLECT) {
+			// the result list is under the element
+			if (!auraS_append(&ctx->stack))
+				raise_error(ctx, "Out of list memory");
+			phase = SEQ_NEXT;
+			continue;
+		}
+		ci->pc = nstage;
+		push_eval(ctx, ci->t[1], ci->v[1], 0);
+		return;
+	}
+done:
+	endcall(ctx);
+}
+
+static union aura_var
+check_seq(struct aura_context *ctx, int idx) {
+	union aura_var seq, zero;
+	int t = auraS_get(&ctx->stack, idx, &seq);
+	if (t == AURA_TSEQ)
+		return seq;
+	t = check_list(ctx, idx, &seq);
+	zero.d = 0;
+	new_seq(ctx, SEQ_LIST, t, seq, zero, zero);
+	auraS_get(&ctx->stack, -1, &seq);
+	auraS_pop(&ctx->stack, 1);
+	return seq;
+}
+
+// seq [body] each
+static void
+cfunc_each(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	union aura_var seq = check_seq(ctx, -2);
+	union aura_var body;
+	int bt = auraS_get(&ctx->stack, -1, &body);
+	auraS_pop(&ctx->stack, 2);
+	seq_consume(ctx, seq, SEQ_EACH, bt, body);
+}
+
+// seq collect -> list
+static void
+cfunc_collect(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	union aura_var seq = check_seq(ctx, -1);
+	union aura_var empty = new_dlist(ctx, 0);
+	union aura_var none;
+	none.d = 0;
+	auraS_pop(&ctx->stack, 1);
+	auraS_pushdlist(&ctx->stack, empty.dlist.offset, 0);
+	seq_consume(ctx, seq, SEQ_COLLECT, AURA_TFALSE, none);
+}
+
+/*
+	map, filter and fold run the body in the frame of the caller, like times.
+	list [f] map -> list
+	list [pred] filter -> list
+	list init [f] fold -> value
+ */
+static struct aura_callinfo *
+list_continuation(struct aura_context *ctx, int kind) {
 	union aura_var list;
-	list.dlist.offset = u.id[0];
-	list.dlist.size = u.id[1];
-	execute_dlist(ctx, list);
+	int t = check_list(ctx, -2, &list);
+	struct aura_callinfo *ci = newcontinuation(ctx, kind, 2);
+	ci->n = 0;
+	if (kind != CI_FOLD) {
+		ci->v[0] = copy_dlist(ctx, t, list, list_size(ctx, t, list));
+		ci->t[0] = AURA_TDLIST;
+	}
+	return ci;
+}
+
+static void
+cfunc_map(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	if (auraS_type(&ctx->stack, -2) == AURA_TSEQ)
+		seq_stage(ctx, SEQ_MAP);
+	else
+		list_continuation(ctx, CI_MAP);
+}
+
+static void
+cfunc_filter(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -2))
+		aura_error(ctx, "Stack empty");
+	if (auraS_type(&ctx->stack, -2) == AURA_TSEQ)
+		seq_stage(ctx, SEQ_FILTER);
+	else
+		list_continuation(ctx, CI_FILTER);
+}
+
+static struct aura_callinfo *
+fold_continuation(struct aura_context *ctx) {
+	union aura_var list, body;
+	int t = check_list(ctx, -3, &list);
+	int bt = auraS_get(&ctx->stack, -1, &body);
+	auraS_copy(&ctx->stack, -2, -3);	// init is the accumulator
+	auraS_pop(&ctx->stack, 2);
+	struct aura_callinfo *ci = newcall(ctx, CI_FOLD);
+	ci->n = 0;
+	ci->t[0] = t;
+	ci->v[0] = list;
+	ci->t[1] = bt;
+	ci->v[1] = body;
+	return ci;
+}
+
+static void
+cfunc_fold(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -3))
+		aura_error(ctx, "Stack empty");
+	if (auraS_type(&ctx->stack, -3) == AURA_TSEQ) {
+		// seq init [f] : the accumulator stays on the stack
+		union aura_var seq, body;
+		auraS_get(&ctx->stack, -3, &seq);
+		int bt = auraS_get(&ctx->stack, -1, &body);
+		auraS_copy(&ctx->stack, -2, -3);
+		auraS_pop(&ctx->stack, 2);
+		seq_consume(ctx, seq, SEQ_FOLD, bt, body);
+		return;
+	}
+	fold_continuation(ctx);
+}
+
+/*
+	pmap and pfold split the list into chunks run by a pool of worker threads.
+	Each worker has its own context : a copy of the words, the progs, the arrays, the host buffers and the list heap of the caller,
+	and its own compiled code. The chunks are resolved before the workers start, so the code is read only.
+	The bodies run in a copy of the frame of the caller, so they read its locals and their writes are dropped
+	(the serial fallback does the same). They can't yield or call async words, and the results must be values
+	(not dlists, dicts, sequences or coroutines). Host words called by the bodies must be thread safe.
+ */
+struct worker_state {
+	jmp_buf jmp;
+	const char *err;
+	unsigned job;	// the job synced into the context
+	int synced;
+	uint32_t epoch;	// the epoch and codegen of the parent at the last sync
+	uint32_t codegen;
+};
+
+struct parallel_job {
+	struct aura_context *ctx;
+	unsigned id;
+	int heap_n;	// the temporary heap before the result
+	int t;
+	int bt;
+	int fold;
+	int n;
+	int chunk;
+	int failed;
+	const char *err;
+	union aura_var list;
+	union aura_var body;
+	union aura_var init;
+	int it;
+	union aura_var result;	// dlist of the results, or of the partial folds
+	struct aura_stackframe frame;	// the frame of the caller
+};
+
+static void
+worker_error(void *ud, const char *msg) {
+	struct worker_state *ws = (struct worker_state *)ud;
+	ws->err = msg;
+	longjmp(ws->jmp, 1);
+}
+
+static void
+resolve_tree(struct aura_context *ctx, int progid, int offset, int n) {
+	resolve_block(ctx, progid, offset, n);
+	const union list_node *node = ctx->prog[progid];
+	int i;
+	for (i=0;i<n;i++) {
+		const union list_node *index = &node[offset + i];
+		if (index->index.type == AURA_TLIST) {
+			const union list_node *data = &node[index->index.offset];
+			resolve_tree(ctx, progid, data->list.offset, data->list.n);
+		}
+	}
+}
+
+static void
+stop_workers(struct aura_context *ctx) {
+	auraT_delete(ctx->pool);
+	ctx->pool = NULL;
+	int i;
+	for (i=0;i<ctx->worker_n;i++) {
+		free(ctx->worker[i]->ud);
+		aura_close(ctx->worker[i]);
+	}
+	free(ctx->worker);
+	ctx->worker = NULL;
+	ctx->worker_n = 0;
+}
+
+static int
+start_workers(struct aura_context *ctx) {
+	if (ctx->pool)
+		return 1;
+	int n = ctx->worker_max > 0 ? ctx->worker_max : auraT_cpus();
+	if (n > AURA_MAXWORKERS)
+		n = AURA_MAXWORKERS;
+	if (n < 2)
+		return 0;
+	ctx->worker = (struct aura_context **)malloc(n * sizeof(struct aura_context *));
+	if (ctx->worker == NULL)
+		return 0;
+	int i;
+	for (i=0;i<n;i++) {
+		struct worker_state *ws = (struct worker_state *)malloc(sizeof(*ws));
+		struct aura_context *w = ws ? aura_newstate(ws, worker_error) : NULL;
+		if (w == NULL) {
+			free(ws);
+			break;
+		}
+		ws->job = 0;
+		ws->synced = 0;
+		w->parent = ctx;
+		ctx->worker[ctx->worker_n++] = w;
+	}
+	if (ctx->worker_n == n)
+		ctx->pool = auraT_new(n - 1);
+	return ctx->pool != NULL;
 }
 
 static void
-cfunc_def(struct aura_context *ctx, void *ud) {
-	if (!auraS_checkstack(&ctx->stack, -2))
-		aura_error(ctx, "Stack empty");
-	union aura_var word, list;
-	if (auraS_get(&ctx->stack, -1, &word) != AURA_TWORDREF)
-		aura_error(ctx, "def need wordref");
-	assert(word.word >=0 && word.word < AURA_MAXWORDS);
-	struct aura_word * w = &ctx->words.w[word.word];
-	if (w->func != NULL)
-		aura_error(ctx, "Already defined");
-	int t = auraS_get(&ctx->stack, -2, &list);
-	if (t == AURA_TLIST) {
-		union {
-			void *ud;
-			struct slist_arg arg;
-		} u;
-		u.arg.offset = list.slist.offset;
-		u.arg.size = list.slist.size;
-		u.arg.prog = list.slist.prog;
-		w->func = cfunc_evalslist;
-		w->u.ud = u.ud;
+sync_context(struct aura_context *w, const struct aura_context *ctx) {
+	struct worker_state *ws = (struct worker_state *)w->ud;
+	// keep the code of the worker unless a word it depends on is rebound
+	int flush = !ws->synced || ws->codegen != ctx->codegen;
+	uint8_t inlined[AURA_MAXWORDS];
+	int i;
+	for (i=0;i<w->words.n;i++) {
+		const struct aura_word *old = &w->words.w[i];
+		inlined[i] = old->inlined;
+		if (old->inlined && old->version != ctx->words.w[i].version)
+			flush = 1;
+	}
+	int n = w->words.n;
+	w->words = ctx->words;
+	if (flush) {
+		flush_code(w);
 	} else {
-		if (t != AURA_TDLIST) {
-			aura_error(ctx, "def need list");
-		}
-		if (!auraS_persistence(&ctx->stack)) {
-			aura_error(ctx, "def can't persistence list");
-		}
-		w->func = cfunc_evaldlist;
-		w->u.id[0] = list.dlist.offset;
-		w->u.id[1] = list.dlist.size;
+		for (i=0;i<n;i++)
+			w->words.w[i].inlined = inlined[i];
+		for (;i<w->words.n;i++)
+			w->words.w[i].inlined = 0;
 	}
-	auraS_pop(&ctx->stack, 2);
+	w->locals = ctx->locals;
+	memcpy(w->prog, ctx->prog, sizeof(ctx->prog));
+	memcpy(w->buffer, ctx->buffer, sizeof(ctx->buffer));
+	if (w->udata_cap < ctx->udata_n) {
+		struct aura_userdata *u = (struct aura_userdata *)realloc(w->udata, ctx->udata_n * sizeof(*u));
+		if (u == NULL)
+			raise_error(w, "Out of memory");
+		w->udata = u;
+		w->udata_cap = ctx->udata_n;
+	}
+	if (ctx->udata_n > 0)
+		memcpy(w->udata, ctx->udata, ctx->udata_n * sizeof(*w->udata));
+	w->udata_n = ctx->udata_n;
+	if (w->ctype_cap < ctx->ctype_n) {
+		struct aura_ctype *c = (struct aura_ctype *)realloc(w->ctype, ctx->ctype_n * sizeof(*c));
+		if (c == NULL)
+			raise_error(w, "Out of memory");
+		w->ctype = c;
+		w->ctype_cap = ctx->ctype_n;
+	}
+	if (ctx->ctype_n > 0)
+		memcpy(w->ctype, ctx->ctype, ctx->ctype_n * sizeof(*w->ctype));
+	w->ctype_n = ctx->ctype_n;
+	// the caches of the memo words are private to each worker
+	for (i=0;i<w->memo_n;i++) {
+		free(w->memo[i].slot);
+	}
+	w->memo_n = 0;
+	if (w->memo_cap < ctx->memo_n) {
+		struct aura_memo *m = (struct aura_memo *)realloc(w->memo, ctx->memo_n * sizeof(*m));
+		if (m == NULL)
+			raise_error(w, "Out of memory");
+		w->memo = m;
+		w->memo_cap = ctx->memo_n;
+	}
+	for (i=0;i<ctx->memo_n;i++) {
+		w->memo[i] = ctx->memo[i];
+		w->memo[i].slot = NULL;
+	}
+	w->memo_n = ctx->memo_n;
+	new_epoch(w);
+	ws->synced = 1;
+	ws->epoch = ctx->epoch;
+	ws->codegen = ctx->codegen;
 }
 
-static inline float
-tofloat(struct aura_context *ctx, int t, union aura_var v) {
-	if (t == AURA_TFLOAT)
-		return v.f;
-	else if (t == AURA_TINT)
-		return (float)v.d;
-	else {
-		aura_error(ctx, "Need a number");
-		return 0;
-	}
+/*
+	The words, progs and buffers are copied only when the parent changed them (they all start a new epoch),
+	so the compiled code of the worker is kept across the jobs. The lists are copied for each job.
+ */
+static void
+sync_worker(struct aura_context *w, const struct parallel_job *job) {
+	const struct aura_context *ctx = job->ctx;
+	struct worker_state *ws = (struct worker_state *)w->ud;
+	if (!ws->synced || ws->epoch != ctx->epoch || ws->codegen != ctx->codegen || w->words.n != ctx->words.n)
+		sync_context(w, ctx);
+	auraS_copyheap(&w->stack, &ctx->stack, job->heap_n);
 }
 
 static void
-cfunc_basicmath(struct aura_context *ctx, void *ud) {
-	if (!auraS_checkstack(&ctx->stack, -2))
-		aura_error(ctx, "Stack empty");
-	union aura_var left, right;
-	int lt = auraS_get(&ctx->stack, -2, &left);
-	int rt = auraS_get(&ctx->stack, -1, &right);
-	int op = (int)(intptr_t)ud;
-	auraS_pop(&ctx->stack, 2);
-	if (lt == AURA_TINT && rt == AURA_TINT) {
-		int lv = left.d;
-		int rv = right.d;
-		switch (op) {
-		case '+':
-			auraS_pushint(&ctx->stack, lv + rv);
-			break;
-		case '-':
-			auraS_pushint(&ctx->stack, lv - rv);
-			break;
-		case '*':
-			auraS_pushint(&ctx->stack, lv * rv);
-			break;
-		case '/':
-			if (rv == 0)
-				aura_error(ctx, "Divide zero");
-			auraS_pushint(&ctx->stack, lv / rv);
-			break;
-		case '>':
-			auraS_pushboolean(&ctx->stack, lv > rv);
-			break;
-		case '<':
-			auraS_pushboolean(&ctx->stack, lv < rv);
-			break;
-		case '}':	// >=
-			auraS_pushboolean(&ctx->stack, lv >= rv);
-			break;
-		case '{':	// <=
-			auraS_pushboolean(&ctx->stack, lv <= rv);
-			break;
+run_body(struct aura_context *w, const struct parallel_job *job) {
+	push_eval(w, job->bt, job->body, 1);
+	w->frame[w->stackframe-1] = job->frame;
+	if (execute(w, 0) != EXEC_DONE)
+		raise_error(w, "Parallel body can't yield");
+	if (!auraS_checkstack(&w->stack, -1))
+		raise_error(w, "Stack empty");
+	int rt = auraS_type(&w->stack, -1);
+	if (rt == AURA_TDLIST || rt == AURA_TDICT || rt == AURA_TSEQ || rt == AURA_TCOROUTINE)
+		raise_error(w, "Parallel result must be a value");
+}
+
+static void
+parallel_task(void *ud, int worker, int task) {
+	struct parallel_job *job = (struct parallel_job *)ud;
+	if (__atomic_load_n(&job->failed, __ATOMIC_RELAXED))
+		return;
+	struct aura_context *ctx = job->ctx;
+	struct aura_context *w = ctx->worker[worker];
+	struct worker_state *ws = (struct worker_state *)w->ud;
+	if (setjmp(ws->jmp)) {
+		if (!__atomic_exchange_n(&job->failed, 1, __ATOMIC_RELAXED))
+			job->err = ws->err;
+		return;
+	}
+	if (ws->job != job->id) {
+		sync_worker(w, job);
+		ws->job = job->id;
+	}
+	int from = task * job->chunk;
+	int to = from + job->chunk;
+	if (to > job->n)
+		to = job->n;
+	int i;
+	union aura_var v;
+	int vt;
+	if (job->fold) {
+		auraS_pushvar(&w->stack, job->it, job->init);
+		for (i=from;i<to;i++) {
+			push_element(w, job->t, job->list, i);
+			run_body(w, job);
 		}
+		vt = auraS_get(&w->stack, -1, &v);
+		AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, job->result.dlist.offset + task, vt, v);
 	} else {
-		float lv = tofloat(ctx, lt, left);
-		float rv = tofloat(ctx, rt, right);
-		switch (op) {
-		case '+':
-			auraS_pushfloat(&ctx->stack, lv + rv);
-			break;
-		case '-':
-			auraS_pushfloat(&ctx->stack, lv - rv);
-			break;
-		case '*':
-			auraS_pushfloat(&ctx->stack, lv * rv);
-			break;
-		case '/':
-			if (rv == 0)
-				aura_error(ctx, "Divide zero");
-			auraS_pushfloat(&ctx->stack, lv / rv);
-			break;
-		case '>':
-			auraS_pushboolean(&ctx->stack, lv > rv);
-			break;
-		case '<':
-			auraS_pushboolean(&ctx->stack, lv < rv);
-			break;
-		case '}':	// >=
-			auraS_pushboolean(&ctx->stack, lv >= rv);
-			break;
-		case '{':	// <=
-			auraS_pushboolean(&ctx->stack, lv <= rv);
-			break;
+		for (i=from;i<to;i++) {
+			push_element(w, job->t, job->list, i);
+			run_body(w, job);
+			vt = auraS_get(&w->stack, -1, &v);
+			AURA_SLOTSET(ctx->stack.list_t, ctx->stack.list, job->result.dlist.offset + i, vt, v);
+			auraS_pop(&w->stack, 1);
 		}
 	}
+	auraS_settop(&w->stack, 0);
 }
 
+// Returns 0 to run serially, or the dlist of the results
 static int
-compare(struct aura_context *ctx) {
-	union aura_var left, right;
-	int lt = auraS_get(&ctx->stack, -2, &left);
-	int rt = auraS_get(&ctx->stack, -1, &right);
-	auraS_pop(&ctx->stack, 2);
-	if (lt == rt) {
-		switch (lt) {
-		case AURA_TLIST:
-			return left.slist.prog == right.slist.prog &&
-				left.slist.offset == right.slist.offset &&
-				left.slist.size == right.slist.size;
-		case AURA_TDLIST:
-			return left.dlist.offset == right.dlist.offset &&
-				left.dlist.size == right.dlist.size;
-		case AURA_TWORD:
-		case AURA_TWORDREF:
-			return left.word == right.word;
-		case AURA_TINT:
-			return left.d == right.d;
-		case AURA_TFLOAT:
-			return left.f == right.f;
-		default:
-			return 1;
-		}
-	} else if (lt == AURA_TINT && rt == AURA_TFLOAT) {
-		return (float)left.d == right.f;
-	} else if (lt == AURA_TFLOAT && rt == AURA_TINT) {
-		return left.f == (float)right.d;
-	} else {
+parallel_run(struct aura_context *ctx, int fold, union aura_var *result) {
+	union aura_var list;
+	int t = check_list(ctx, fold ? -3 : -2, &list);
+	int n = list_size(ctx, t, list);
+	if (n < AURA_PARALLELMIN || ctx->parent || !start_workers(ctx))
 		return 0;
+	static unsigned jobid = 0;
+	struct parallel_job job;
+	job.ctx = ctx;
+	job.id = __atomic_add_fetch(&jobid, 1, __ATOMIC_RELAXED);
+	job.t = t;
+	job.list = list;
+	job.bt = auraS_get(&ctx->stack, -1, &job.body);
+	if (job.bt != AURA_TLIST && job.bt != AURA_TDLIST)
+		aura_error(ctx, "Eval need a list");
+	job.it = fold ? auraS_get(&ctx->stack, -2, &job.init) : AURA_TFALSE;
+	if (!fold)
+		job.init.d = 0;
+	job.fold = fold;
+	job.n = n;
+	if (ctx->stackframe > 0) {
+		job.frame = *currentframe(ctx);
+	} else {
+		job.frame.n = 0;
+		job.frame.maxid = 0;
+	}
+	job.failed = 0;
+	job.err = NULL;
+	// a few chunks per worker to balance the load
+	job.chunk = (n + ctx->worker_n * 4 - 1) / (ctx->worker_n * 4);
+	int ntask = (n + job.chunk - 1) / job.chunk;
+	int i;
+	for (i=0;i<AURA_MAXPROG;i++) {
+		union list_node *prog = ctx->prog[i];
+		if (prog && prog[-1].list.offset) {
+			const union list_node *root = &prog[prog[0].index.offset];
+			resolve_tree(ctx, i, root->list.offset, root->list.n);
+		}
 	}
+	job.heap_n = ctx->stack.list_n;
+	job.result = new_dlist(ctx, fold ? ntask : n);
+	auraT_run(ctx->pool, ntask, parallel_task, &job);
+	if (job.failed)
+		aura_error(ctx, job.err);
+	*result = job.result;
+	return 1;
 }
 
-static void
-cfunc_compare(struct aura_context *ctx, void *ud) {
-	if (!auraS_checkstack(&ctx->stack, -2))
-		aura_error(ctx, "Stack empty");
-	int r = (ud != NULL) ^ compare(ctx);
-	auraS_pushboolean(&ctx->stack, r);
+void
+aura_setworkers(struct aura_context *ctx, int n) {
+	stop_workers(ctx);
+	ctx->worker_max = n;
 }
 
+// list [f] pmap -> list, as map
 static void
-cfunc_if(struct aura_context *ctx, void *ud) {
+cfunc_pmap(struct aura_context *ctx, void *ud) {
 	if (!auraS_checkstack(&ctx->stack, -2))
 		aura_error(ctx, "Stack empty");
-	auraS_swap(&ctx->stack);
-	cfunc_upeval(ctx, NULL);
-	if (ctx->stack.type[ctx->stack.top-1] != AURA_TFALSE) {
-		auraS_pop(&ctx->stack, 1);
-		cfunc_upeval(ctx, NULL);
-	} else {
-		auraS_pop(&ctx->stack, 2);
+	union aura_var r;
+	if (auraS_type(&ctx->stack, -2) == AURA_TSEQ) {
+		cfunc_map(ctx, ud);
+		return;
+	}
+	if (!parallel_run(ctx, 0, &r)) {
+		list_continuation(ctx, CI_MAP)->n = 1;
+		return;
 	}
+	auraS_pop(&ctx->stack, 2);
+	auraS_pushdlist(&ctx->stack, r.dlist.offset, r.dlist.size);
 }
 
+/*
+	list init [f] pfold -> value
+	Each chunk is folded from init, then the partial results are folded from init again,
+	so f must be associative and init its identity.
+ */
 static void
-cfunc_ifelse(struct aura_context *ctx, void *ud) {
+cfunc_pfold(struct aura_context *ctx, void *ud) {
 	if (!auraS_checkstack(&ctx->stack, -3))
 		aura_error(ctx, "Stack empty");
-	auraS_rotate(&ctx->stack, -3, -1);
-	cfunc_upeval(ctx, NULL);
-	if (ctx->stack.type[ctx->stack.top-1] != AURA_TFALSE) {
-		auraS_pop(&ctx->stack, 2);
-	} else {
-		auraS_copy(&ctx->stack, -2, -3);
-		auraS_pop(&ctx->stack, 2);
+	union aura_var r;
+	if (auraS_type(&ctx->stack, -3) == AURA_TSEQ) {
+		cfunc_fold(ctx, ud);
+		return;
 	}
-	cfunc_upeval(ctx, NULL);
+	// or fold the partial results : partials init [f] fold
+	if (parallel_run(ctx, 1, &r))
+		AURA_SLOTSET(ctx->stack.type, ctx->stack.v, ctx->stack.top - 3, AURA_TDLIST, r);
+	fold_continuation(ctx)->n = 1;
 }
 
 static void
-cfunc_while(struct aura_context *ctx, void *ud) {
+cfunc_coroutine(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	union aura_var body;
+	int t = auraS_get(&ctx->stack, -1, &body);
+	int id = coroutine_create(ctx, t, body);
+	auraS_pop(&ctx->stack, 1);
+	union aura_var v;
+	v.d = id;
+	auraS_pushvar(&ctx->stack, AURA_TCOROUTINE, v);
+}
+
+// value co resume
+static void
+cfunc_resume(struct aura_context *ctx, void *ud) {
 	if (!auraS_checkstack(&ctx->stack, -2))
 		aura_error(ctx, "Stack empty");
+	union aura_var h, x;
+	if (auraS_get(&ctx->stack, -1, &h) != AURA_TCOROUTINE)
+		aura_error(ctx, "resume need a coroutine");
+	int t = auraS_get(&ctx->stack, -2, &x);
+	struct aura_coroutine *co = getcoroutine(ctx, h.d);
+	if (co == NULL || co->status != CO_SUSPENDED || co->wait)
+		aura_error(ctx, "Cannot resume coroutine");
+	auraS_pop(&ctx->stack, 2);
+	ctx->co[ctx->current]->status = CO_NORMAL;
+	co->resumer = ctx->current;
+	co->status = CO_RUNNING;
+	coroutine_switch(ctx, h.d & 0xffff);
 	if (!auraS_checkstack(&ctx->stack, 1))
 		aura_error(ctx, "Stack overflow");
-	for (;;) {
-		auraS_pushvalue(&ctx->stack, -2);
-		cfunc_upeval(ctx, NULL);
-		if (ctx->stack.type[ctx->stack.top-1] != AURA_TFALSE) {
-			auraS_pop(&ctx->stack, 1);	// pop true
-			auraS_pushvalue(&ctx->stack, -1);	// push prog
-			cfunc_upeval(ctx, NULL);
-		} else {
-			auraS_pop(&ctx->stack, 3);
-			return;
-		}
+	auraS_pushvar(&ctx->stack, t, x);
+	ctx->interrupt = INTERRUPT_SWITCH;
+}
+
+// value yield, to the host the value is kept on the stack
+static void
+cfunc_yield(struct aura_context *ctx, void *ud) {
+	struct aura_coroutine *co = ctx->co[ctx->current];
+	if (co->resumer < 0) {
+		ctx->interrupt = INTERRUPT_YIELD;
+		return;
 	}
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	union aura_var y;
+	int t = auraS_get(&ctx->stack, -1, &y);
+	auraS_pop(&ctx->stack, 1);
+	co->status = CO_SUSPENDED;
+	ctx->co[co->resumer]->status = CO_RUNNING;
+	coroutine_switch(ctx, co->resumer);
+	if (!auraS_checkstack(&ctx->stack, 1))
+		aura_error(ctx, "Stack overflow");
+	auraS_pushvar(&ctx->stack, t, y);
+	ctx->interrupt = INTERRUPT_SWITCH;
+}
+
+static void
+cfunc_alive(struct aura_context *ctx, void *ud) {
+	if (!auraS_checkstack(&ctx->stack, -1))
+		aura_error(ctx, "Stack empty");
+	union aura_var h;
+	if (auraS_get(&ctx->stack, -1, &h) != AURA_TCOROUTINE)
+		aura_error(ctx, "alive need a coroutine");
+	auraS_pop(&ctx->stack, 1);
+	auraS_pushboolean(&ctx->stack, getcoroutine(ctx, h.d) != NULL);
 }
 
 struct aura_context *
@@ -638,6 +5524,12 @@ aura_newstate(void *ud, aura_errfunction errfunc) {
 	memset(ctx, 0, sizeof(*ctx));
 	ctx->ud = ud;
 	ctx->errfunc = errfunc;
+	ctx->co_free = -1;
+	ctx->udata_free = -1;
+	ctx->epoch = 1;
+	newcoroutine(ctx, AURA_STACKSIZE);	// main thread
+	ctx->co[0]->status = CO_RUNNING;
+	load_thread(ctx, &ctx->co[0]->th);
 
 	aura_register(ctx, "true", push_boolean, (void *)1);
 	aura_register(ctx, "false", push_boolean, (void *)0);
@@ -647,6 +5539,62 @@ aura_newstate(void *ud, aura_errfunction errfunc) {
 	aura_register(ctx, "if", cfunc_if, NULL);
 	aura_register(ctx, "ifelse", cfunc_ifelse, NULL);
 	aura_register(ctx, "while", cfunc_while, NULL);
+	aura_register(ctx, "times", cfunc_times, NULL);
+	aura_register(ctx, "for", cfunc_for, NULL);
+	aura_register(ctx, "coroutine", cfunc_coroutine, NULL);
+	aura_register(ctx, "resume", cfunc_resume, NULL);
+	aura_register(ctx, "yield", cfunc_yield, NULL);
+	aura_register(ctx, "alive", cfunc_alive, NULL);
+	aura_register(ctx, "newlist", cfunc_newlist, NULL);
+	aura_register(ctx, "length", cfunc_length, NULL);
+	aura_register(ctx, "nth", cfunc_nth, NULL);
+	aura_register(ctx, "set", cfunc_set, NULL);
+	aura_register(ctx, "slice", cfunc_slice, NULL);
+	aura_register(ctx, "append", cfunc_append, NULL);
+	aura_register(ctx, "map", cfunc_map, NULL);
+	aura_register(ctx, "filter", cfunc_filter, NULL);
+	aura_register(ctx, "fold", cfunc_fold, NULL);
+	aura_register(ctx, "newdict", cfunc_newdict, NULL);
+	aura_register(ctx, "put", cfunc_put, NULL);
+	aura_register(ctx, "get", cfunc_get, NULL);
+	aura_register(ctx, "has", cfunc_has, NULL);
+	aura_register(ctx, "del", cfunc_del, NULL);
+	aura_register(ctx, "keys", cfunc_keys, NULL);
+	aura_register(ctx, "values", cfunc_keys, (void *)1);
+	aura_register(ctx, "compare", cfunc_strcompare, NULL);
+	aura_register(ctx, "hash", cfunc_hash, NULL);
+	aura_register(ctx, "find", cfunc_find, NULL);
+	aura_register(ctx, "split", cfunc_split, NULL);
+	aura_register(ctx, "v+", cfunc_vbinop, (void *)AURA_VADD);
+	aura_register(ctx, "v-", cfunc_vbinop, (void *)AURA_VSUB);
+	aura_register(ctx, "v*", cfunc_vbinop, (void *)AURA_VMUL);
+	aura_register(ctx, "v/", cfunc_vbinop, (void *)AURA_VDIV);
+	aura_register(ctx, "v<", cfunc_vbinop, (void *)AURA_VLT);
+	aura_register(ctx, "v>", cfunc_vbinop, (void *)AURA_VGT);
+	aura_register(ctx, "v<=", cfunc_vbinop, (void *)AURA_VLE);
+	aura_register(ctx, "v>=", cfunc_vbinop, (void *)AURA_VGE);
+	aura_register(ctx, "v==", cfunc_vbinop, (void *)AURA_VEQ);
+	aura_register(ctx, "vsum", cfunc_vreduce, (void *)AURA_VSUM);
+	aura_register(ctx, "vmin", cfunc_vreduce, (void *)AURA_VMIN);
+	aura_register(ctx, "vmax", cfunc_vreduce, (void *)AURA_VMAX);
+	aura_register(ctx, "vdot", cfunc_vdot, NULL);
+	aura_register(ctx, "vaxpy", cfunc_vaxpy, NULL);
+	aura_register(ctx, "sort", cfunc_sort, NULL);
+	aura_register(ctx, "sort-by", cfunc_sortby, NULL);
+	aura_register(ctx, "binsearch", cfunc_binsearch, NULL);
+	aura_register(ctx, "unique", cfunc_unique, NULL);
+	aura_register(ctx, "iota", cfunc_iota, NULL);
+	aura_register(ctx, "range", cfunc_range, NULL);
+	aura_register(ctx, "lazy", cfunc_lazy, NULL);
+	aura_register(ctx, "generator", cfunc_generator, NULL);
+	aura_register(ctx, "take", cfunc_take, NULL);
+	aura_register(ctx, "each", cfunc_each, NULL);
+	aura_register(ctx, "collect", cfunc_collect, NULL);
+	aura_register(ctx, "pmap", cfunc_pmap, NULL);
+	aura_register(ctx, "pfold", cfunc_pfold, NULL);
+	aura_register(ctx, "defmemo", cfunc_defmemo, NULL);
+	aura_register(ctx, "memo-clear", cfunc_memoclear, NULL);
+	aura_register(ctx, "memo-stats", cfunc_memostats, NULL);
 	aura_register(ctx, "+", cfunc_basicmath, (void *)'+');
 	aura_register(ctx, "-", cfunc_basicmath, (void *)'-');
 	aura_register(ctx, "*", cfunc_basicmath, (void *)'*');
@@ -690,6 +5638,9 @@ print(struct aura_context *ctx, void *ud) {
 	case AURA_TLIST:
 		printf("[LIST]\n");
 		break;
+	case AURA_TSTRING:
+		printf("[STRING] %.*s\n", (int)v.str.size, auraS_string(&ctx->stack, v));
+		break;
 	default:
 		printf("[UNKNOWN]\n");
 		break;
@@ -697,6 +5648,65 @@ print(struct aura_context *ctx, void *ud) {
 	auraS_pop(&ctx->stack, 1);
 }
 
+static const char logline_[] = "GET /index.html 200";
+static float sensor_[4] = { 1, 2, 3, 4 };
+static int32_t counts_[3];
+
+static void
+pusharray(struct aura_context *ctx, void *ud) {
+	aura_pusharray(ctx, (int)(intptr_t)ud);
+}
+
+static void
+logline(struct aura_context *ctx, void *ud) {
+	aura_pushstring(ctx, 100, 0, sizeof(logline_) - 1);
+}
+
+static void
+negate(struct aura_context *ctx, void *ud) {
+	union aura_var v;
+	auraS_get(&ctx->stack, -1, &v);
+	auraS_pop(&ctx->stack, 1);
+	auraS_pushint(&ctx->stack, -v.d);
+}
+
+static void
+drop(struct aura_context *ctx, void *ud) {
+	printf("[DROP]\n");
+	auraS_pop(&ctx->stack, 1);
+}
+
+static void
+myif(struct aura_context *ctx, void *ud) {
+	printf("[MYIF]\n");
+	auraS_pop(&ctx->stack, 2);
+}
+
+static int32_t
+gcd(int32_t a, int32_t b) {
+	while (b) {
+		int32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+static float
+lerp(float a, float b, float t) {
+	return a + (b - a) * t;
+}
+
+static int
+iseven(int32_t n) {
+	return n % 2 == 0;
+}
+
+static float
+pick(int c, float a, float b) {
+	return c ? a : b;
+}
+
 int
 main() {
 	struct aura_context *ctx = aura_newstate(NULL, errorhook);
@@ -726,6 +5736,316 @@ main() {
 	aura_load(ctx, source2, sizeof(source2), output2);
 	aura_run(ctx, 1, output2);
 
+	char source3[] =
+		"0 1 100 [+] for print "
+		"0 (s) 1000000 [$s 1 + (s)] times $s print "
+		"[1 2 <] [3 print] [4 print] ifelse "
+		"[1 2 >] [5 print] if "
+		"0 3 [ [1 +] ] eval times print "
+		"0 1 4 [ [+] ] eval for print "
+		"[(n) [$n 0 >] [$n 1 - countdown] [$n] ifelse] 'countdown def "
+		"1000000 countdown print "
+		"[(n) [$n 0 ==] [0] [$n 1 - sum $n +] ifelse] 'sum def "
+		"10000 sum print "
+		"[ [1 2 <] [6 print] [7 print] ] eval ifelse "
+		"[ [1 2 <] [8 print] ] eval if "
+		"1 (i) [ [$i 4 <] [$i 2 * (i)] ] eval while $i print ";
+	char output3[AURA_MAXCHUNKSIZE];
+
+	aura_load(ctx, source3, sizeof(source3), output3);
+	aura_run(ctx, 2, output3);
+
+	char source4[] =
+		"0 (s) [$s 10000 <] [$s 1 + (s)] while $s print ";
+	char output4[AURA_MAXCHUNKSIZE];
+
+	aura_load(ctx, source4, sizeof(source4), output4);
+	aura_start(ctx, 3, output4);
+	int slices = 1;
+	while (aura_resume(ctx, 1000) == AURA_YIELD)
+		++slices;
+	printf("slices = %d\n", slices);
+
+	char source5[] =
+		"[(x) 1 3 [yield (x)] for 0] coroutine (g) "
+		"0 $g resume print 0 $g resume print 0 $g resume print 0 $g resume print "
+		"$g alive print "
+		"[ 1 3 [print 0 yield (x)] for ] 'agent def ";
+	char output5[AURA_MAXCHUNKSIZE];
+
+	aura_load(ctx, source5, sizeof(source5), output5);
+	aura_run(ctx, 4, output5);
+	int co = aura_newcoroutine(ctx, "agent");
+	while (aura_stepcoroutine(ctx, co, 0) == AURA_YIELD)
+		printf("agent yield\n");
+
+	char source6[] =
+		"1.5 2.25 + print 0 7 - print 0.5 3 * print 3 4 != print 7 2 / print ";
+	char output6[AURA_MAXCHUNKSIZE];
+
+	aura_load(ctx, source6, sizeof(source6), output6);
+	aura_run(ctx, 5, output6);
+
+	// rebinding words invalidates the call sites
+	aura_register(ctx, "show", drop, NULL);
+	char source7[] =
+		"[ 5 show ] 'f def [ 3 4 + show ] 'g def f g "
+		"[ 2 * ] 'twice def [ 5 3 twice + show ] 'h def h "
+		"[ 60 60 * 1000 * print ] 'minute def minute ";
+	char output7[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source7, sizeof(source7), output7);
+	aura_run(ctx, 6, output7);
+
+	aura_register(ctx, "show", print, NULL);
+	aura_register(ctx, "+", cfunc_basicmath, (void *)'*');
+	aura_register(ctx, "twice", negate, NULL);	// deopt the inlined word
+	char source8[] = "f g h ";
+	char output8[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source8, sizeof(source8), output8);
+	aura_run(ctx, 7, output8);
+
+	struct aura_loadcache *cache = auraC_new(0x40000);
+	aura_setloadcache(ctx, cache);
+	char source9[] = "6 7 * print ";
+	static char output9[2][AURA_MAXCHUNKSIZE];
+	int i;
+	for (i=0;i<2;i++) {
+		aura_load(ctx, source9, sizeof(source9), output9[i]);
+		aura_run(ctx, 8 + i, output9[i]);
+	}
+	struct aura_cachestat stat;
+	auraC_stat(cache, &stat);
+	printf("cache hit = %d miss = %d\n", stat.hit, stat.miss);
+	aura_setloadcache(ctx, NULL);
+	auraC_delete(cache);
+
+	char source10[] = "[ 1 print ] 'r1 def [ 2 print ] 'r2 def r1 r2 ";
+	char source11[] = "[ 1 print ] 'r1 def [ 20 print ] 'r2 def [ 3 print ] 'r3 def ";
+	char source12[] = "r1 r2 r3 ";
+	static char output10[3][AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source10, sizeof(source10), output10[0]);
+	aura_run(ctx, 10, output10[0]);
+	aura_load(ctx, source11, sizeof(source11), output10[1]);
+	printf("reload = %d\n", aura_reload(ctx, 11, output10[1]));
+	aura_load(ctx, source12, sizeof(source12), output10[2]);
+	aura_run(ctx, 12, output10[2]);
+	// the reload moved r1 to prog 11, so prog 10 can be unloaded and loaded again
+	printf("unload = %d %d\n", aura_unload(ctx, 10), aura_unload(ctx, 11));
+	aura_load(ctx, source11, sizeof(source11), output10[0]);
+	printf("reload = %d\n", aura_reload(ctx, 10, output10[0]));
+	printf("unload = %d\n", aura_unload(ctx, 11));
+	aura_run(ctx, 12, NULL);
+
+	char source13[] =
+		"[1 2 3 4 5] (l) $l length print $l 4 nth print "
+		"$l [2 *] map 4 nth print "
+		"$l [3 >] filter (f) $f length print $f 0 nth print "
+		"$l 0 [-] fold print "
+		"$l 1 3 slice 0 nth print "
+		"$l 1 3 slice [1 -] map 1 nth print "
+		"$l 6 append 5 nth print "
+		"3 newlist 1 7 set 1 nth print "
+		"0 newlist (v) 1 1000 [(i) $v $i append (v)] for $v length print $v 999 nth print "
+		"$v 0 2 slice (w) $w 9 append 2 nth print $v 2 nth print "
+		"0 newdict (d) 1 1000 [(i) $d $i $i 2 * put (d)] for "
+		"$d length print $d 500 get print $d 1001 has print "
+		"$d $d == print $d 0 newdict == print "
+		"$d 'key 42 put 'key del length print "
+		"$d 'table def table 'key has print table 7 get print table keys length print "
+		"3 newlist 0 10 set 'lst def lst print print print ";
+	char output13[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source13, sizeof(source13), output13);
+	aura_run(ctx, 13, output13);
+	char source27[] = "8 newlist (z) 0 newlist 1 append (z) ";
+	char output27[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source27, sizeof(source27), output27);
+	aura_run(ctx, 27, output27);
+	char source28[] = "0 newlist 5 append (z) 1 newlist 7 append (a) 1 newlist 0 99 set (z) $a 1 nth print ";
+	char output28[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source28, sizeof(source28), output28);
+	aura_run(ctx, 28, output28);
+	char source29[] =
+		"0 newdict 1 10 put 'small def small 2 3 newlist 0 77 set put 2 get 0 nth print "
+		"small (t) 100 200 [(i) $t $i $i put (t)] for $t length print $t 150 has print ";
+	char output29[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source29, sizeof(source29), output29);
+	aura_run(ctx, 29, output29);
+	char source30[] = "small length print small 2 has print small 1 get print small 1 del length print small length print ";
+	char output30[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source30, sizeof(source30), output30);
+	aura_run(ctx, 30, output30);
+
+	aura_setbuffer(ctx, 100, logline_, sizeof(logline_) - 1);
+	aura_register(ctx, "logline", logline, NULL);
+	char source14[] =
+		"\"a,b,,c\" \",\" split (p) $p length print $p 3 nth print $p 2 nth length print "
+		"\"abc\" \"abd\" compare print \"hello world\" \"world\" find print "
+		"logline \" \" split 1 nth print logline 4 9 slice print "
+		"\"k\" \"k\" == print \"k\" hash \"k\" hash == print "
+		"0 newdict \"k\" 5 put \"k\" get print ";
+	char output14[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source14, sizeof(source14), output14);
+	aura_run(ctx, 14, output14);
+
+	int sensor = aura_newarray(ctx, sensor_, AURA_FLOAT32, 4);
+	int counts = aura_newarray(ctx, counts_, AURA_INT32, 3);
+	aura_register(ctx, "sensor", pusharray, (void *)(intptr_t)sensor);
+	aura_register(ctx, "counts", pusharray, (void *)(intptr_t)counts);
+	char source15[] =
+		"sensor length print sensor 2 nth print sensor 0 [-] fold print "
+		"sensor [2 *] map 3 nth print counts 1 42 set sensor sensor == print sensor counts == print ";
+	char output15[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source15, sizeof(source15), output15);
+	aura_run(ctx, 15, output15);
+	static const int32_t frame[3] = { 7, 8, 9 };
+	double frame64[3];
+	aura_tolist(ctx, frame, AURA_INT32, 3);
+	int n = aura_fromlist(ctx, -1, frame64, AURA_FLOAT64, 3);
+	auraS_pop(&ctx->stack, 1);
+	printf("counts = %d, frame = %d %g\n", counts_[1], n, frame64[2]);
+	char source16[] =
+		"[1 2 3] [4 5 6] v+ 2 nth print [1 2 3] 2 v* vsum print [3 1 2] vmin print "
+		"[1 2.5] [1 2] v> 1 nth print 2 [1 2 3] [10 20 30] vaxpy 2 nth print "
+		"sensor sensor vdot print sensor 0.5 v* vmax print counts [1 1 1] v- 1 nth print ";
+	char output16[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source16, sizeof(source16), output16);
+	aura_run(ctx, 16, output16);
+	char source17[] =
+		"[5 2 9 1 2] sort (s) $s 0 nth print $s 4 nth print $s 9 binsearch print "
+		"[2.5 1 0.5] sort 0 nth print [\"pear\" \"apple\" \"fig\"] sort 0 nth print "
+		"[3 1 2] [(x) 0 $x -] sort-by 0 nth print $s unique length print "
+		"sensor [(x) 0 $x -] map sort 0 nth print counts sort 2 nth print ";
+	char output17[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source17, sizeof(source17), output17);
+	aura_run(ctx, 17, output17);
+	char source18[] =
+		"10 iota [(x) $x $x *] map [2 >] filter 3 take 0 [-] fold print "
+		"0 (c) 1 1000000 range [(i) $c 1 - (c)] each $c print "
+		"3 (n) [[$n 0 >] [$n $n 1 - (n) true] [false] ifelse] generator collect length print "
+		"[1 2 3] lazy [2 *] map collect 2 nth print [4 5] [(x) $x print] each "
+		"3 iota (q) $q $q == print $q 5 iota == print ";
+	char output18[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source18, sizeof(source18), output18);
+	aura_run(ctx, 18, output18);
+	static int32_t scores[5000];
+	for (n=0;n<5000;n++)
+		scores[n] = n;
+	int batch = aura_newarray(ctx, scores, AURA_INT32, 5000);
+	aura_register(ctx, "scores", pusharray, (void *)(intptr_t)batch);
+	aura_setworkers(ctx, 4);
+	char source19[] =
+		"scores [(x) $x $x *] pmap 4999 nth print "
+		"scores 0 [(a b) $a 0 $b - -] pfold print scores [2 *] pmap 0 [(a b) $a 0 $b - -] pfold print "
+		"[1 2 3] [1 -] pmap 2 nth print ";
+	char output19[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source19, sizeof(source19), output19);
+	aura_run(ctx, 19, output19);
+	// the workers keep their compiled code across the jobs
+	uint32_t worker_gen = ctx->worker[1]->codegen;
+	for (n=0;n<3;n++)
+		aura_run(ctx, 19, output19);
+	printf("worker code kept = %d\n", ctx->worker[1]->codegen == worker_gen);
+	// the bodies read the locals of the caller and drop their writes, with or without the workers
+	char source31[] =
+		"5 (k) 0 (c) 10 iota collect [(x) 1 (c) $x $k -] pmap 9 nth print $c print "
+		"scores [(x) 1 (c) $x $k -] pmap 4999 nth print $c print "
+		"scores 0 [(a b) 1 (c) $a $b $k $k - - -] pfold print $c print ";
+	char output31[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source31, sizeof(source31), output31);
+	aura_run(ctx, 31, output31);
+	char source20[] =
+		"[(a b) $a $b * $a -] 'score def "
+		"[(x) [$x 0 <] [0 $x -] [$x] ifelse] 'absval def ";
+	char output20[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source20, sizeof(source20), output20);
+	aura_run(ctx, 20, output20);
+	static int32_t col_a[100];
+	static float col_b[100];
+	static double col_r[100];
+	for (n=0;n<100;n++) {
+		col_a[n] = n - 50;
+		col_b[n] = 0.5f;
+	}
+	struct aura_column in[2] = { { col_a, AURA_INT32 }, { col_b, AURA_FLOAT32 } };
+	struct aura_column out[1] = { { col_r, AURA_FLOAT64 } };
+	int lanes = aura_runbatch(ctx, "score", in, 2, out, 1, 100);
+	printf("batch lanes = %d, r[0] = %g, r[99] = %g\n", lanes, col_r[0], col_r[99]);
+	lanes = aura_runbatch(ctx, "absval", in, 1, out, 1, 100);
+	printf("batch lanes = %d, r[0] = %g, r[99] = %g\n", lanes, col_r[0], col_r[99]);
+	aura_registertyped(ctx, "gcd", "(int int -- int)", (aura_typedfunction)gcd);
+	aura_registertyped(ctx, "lerp", "(float float float -- float)", (aura_typedfunction)lerp);
+	aura_registertyped(ctx, "even?", "(int -- bool)", (aura_typedfunction)iseven);
+	aura_registertyped(ctx, "pick", "(bool float float -- float)", (aura_typedfunction)pick);
+	char source21[] =
+		"48 18 gcd print 1 3 0.25 lerp print 7 even? print "
+		"[(i) $i 36 gcd] 'g36 def 0 (s) 1 100 [(i) $s $i g36 - (s)] for 0 $s - print "
+		"4 even? 2 0.5 pick print 0 4 1 lerp print";
+	char output21[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source21, sizeof(source21), output21);
+	aura_run(ctx, 21, output21);
+	char source22[] =
+		"[(n) [$n 2 <] [$n] [$n 1 - fibm 0 $n 2 - fibm - -] ifelse] 1 'fibm defmemo "
+		"30 fibm print 'fibm memo-stats print print "
+		"'fibm memo-clear 10 fibm print 10 fibm print 'fibm memo-stats print print";
+	char output22[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source22, sizeof(source22), output22);
+	aura_run(ctx, 22, output22);
+	char source32[] = "[(n) 0 $n -] 1 'fibm defmemo [(n) $n $n *] 1 'sqm defmemo ";
+	static char output32[2][AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source32, sizeof(source32), output32[0]);
+	printf("reload memo = %d\n", aura_reload(ctx, 32, output32[0]));
+	aura_load(ctx, source32, sizeof(source32), output32[1]);
+	printf("reload same memo = %d\n", aura_reload(ctx, 33, output32[1]));
+	char source34[] = "10 fibm print 'fibm memo-stats print print 4 sqm print ";
+	char output34[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source34, sizeof(source34), output34);
+	aura_run(ctx, 34, output34);
+	// a chunk without room for its source keeps its string literals
+	static char source26[0xfffe];
+	memset(source26, ' ', sizeof(source26));
+	memcpy(source26, "\"resolved\" length print", 24);
+	static char output26[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source26, sizeof(source26), output26);
+	aura_run(ctx, 26, output26);
+	char source24[] = "[(x) [$x] [1 print] if] 'tryif def true tryif ";
+	char output24[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source24, sizeof(source24), output24);
+	aura_run(ctx, 24, output24);
+	aura_register(ctx, "if", myif, NULL);
+	printf("code after flush = %d\n", ctx->code.n);
+	char source25[] = "true tryif ";
+	char output25[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source25, sizeof(source25), output25);
+	aura_run(ctx, 25, output25);
+	aura_register(ctx, "if", cfunc_if, NULL);
+#ifdef AURA_PROFILE
+	aura_profile(ctx, 1);
+	char source23[] =
+		"[(n) [$n 2 <] [$n] [$n 1 - fibp 0 $n 2 - fibp - -] ifelse] 'fibp def "
+		"[15 fibp 0 -] 'work def work print "
+		"[1 -] 'dec def [0 (s) 1 1000 [(i) $s dec (s)] for $s 48 18 gcd -] 'inner def inner print";
+	char output23[AURA_MAXCHUNKSIZE];
+	aura_load(ctx, source23, sizeof(source23), output23);
+	aura_run(ctx, 23, output23);
+	struct aura_profentry prof[16];
+	int prof_n = aura_profreport(ctx, prof, 16, AURA_PROFCALLS);
+	for (n=0;n<prof_n && n<16;n++) {
+		if (strcmp(prof[n].name, "fibp") == 0 || strcmp(prof[n].name, "work") == 0
+			|| strcmp(prof[n].name, "dec") == 0 || strcmp(prof[n].name, "gcd") == 0)
+			printf("profile %s calls = %u, total >= self : %d\n", prof[n].name, prof[n].calls, prof[n].total >= prof[n].self);
+	}
+	static char flame[0x10000];
+	int flame_sz = aura_profflame(ctx, flame, sizeof(flame));
+	printf("flame %d bytes, work;fibp;fibp : %d\n", flame_sz, strstr(flame, "work;fibp;fibp;") != NULL);
+	aura_profile(ctx, 0);
+#endif
+	aura_freearray(ctx, batch);
+	int again = aura_newarray(ctx, scores, AURA_INT32, 5000);
+	printf("freed array id reused = %d\n", again == batch);
+	aura_freearray(ctx, again);
+	aura_freearray(ctx, sensor);
+	aura_freearray(ctx, counts);
+
 	aura_close(ctx);
 	return 0;
 }
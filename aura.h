@@ -9,18 +9,91 @@
 #define AURA_TWORDREF 5
 #define AURA_TLOCAL 6
 #define AURA_TLOCALSET 7
+#define AURA_TCOROUTINE 8
+#define AURA_TDICT 9
+#define AURA_TSTRING 10
+#define AURA_TARRAY 11
+#define AURA_TSEQ 12
+
+// element types of the host arrays
+#define AURA_INT32 0
+#define AURA_FLOAT32 1
+#define AURA_FLOAT64 2
 
 #define AURA_MAXCHUNKSIZE 0x10000
 
+#define AURA_OK 0
+#define AURA_YIELD 1
+#define AURA_SUSPEND 2
+
 struct aura_context;
+struct aura_loadcache;
 
 typedef void (*aura_cfunction)(struct aura_context *ctx, void* ud);
 typedef void (*aura_errfunction)(void *ud, const char *msg);
+typedef void (*aura_asyncfunction)(struct aura_context *ctx, int token, int arg, void *ud);
+// any C function, cast to the prototype of its signature when called
+typedef void (*aura_typedfunction)(void);
 
 struct aura_context * aura_newstate(void *ud, aura_errfunction errorhook);
 void aura_close(struct aura_context *ctx);
 void aura_error(struct aura_context *ctx, const char *msg);
 int aura_load(struct aura_context *ctx, const char *source, int sz, char output[AURA_MAXCHUNKSIZE]);
+void aura_setloadcache(struct aura_context *ctx, struct aura_loadcache *cache);
+void aura_run(struct aura_context *ctx, int progid, void *code);
+void aura_start(struct aura_context *ctx, int progid, void *code);
+int aura_reload(struct aura_context *ctx, int progid, void *code);
+// A progid (0 to 4095) is taken until its chunk is unloaded, returns 0 if the chunk is still in use
+int aura_unload(struct aura_context *ctx, int progid);
+int aura_resume(struct aura_context *ctx, int budget);
+int aura_newcoroutine(struct aura_context *ctx, const char *word);
+int aura_stepcoroutine(struct aura_context *ctx, int co, int budget);
+void aura_closecoroutine(struct aura_context *ctx, int co);
 void aura_register(struct aura_context *ctx, const char *name, aura_cfunction func, void *ud);
+void aura_registerasync(struct aura_context *ctx, const char *name, aura_asyncfunction func, void *ud);
+// Register a C function by its signature, such as "(int float -- float)" : up to 3 arguments and 0 or 1 result,
+// int is int32_t, float is float and bool is int
+void aura_registertyped(struct aura_context *ctx, const char *name, const char *sig, aura_typedfunction func);
+void aura_complete(struct aura_context *ctx, int token, int result);
+void aura_setbuffer(struct aura_context *ctx, int id, const char *ptr, int sz);
+void aura_pushstring(struct aura_context *ctx, int id, int offset, int sz);
+int aura_newarray(struct aura_context *ctx, void *ptr, int type, int n);
+void aura_pusharray(struct aura_context *ctx, int id);
+void aura_freearray(struct aura_context *ctx, int id);
+void aura_tolist(struct aura_context *ctx, const void *ptr, int type, int n);
+int aura_fromlist(struct aura_context *ctx, int idx, void *ptr, int type, int n);
+// threads of pmap/pfold, 0 is one per cpu, 1 runs serially
+void aura_setworkers(struct aura_context *ctx, int n);
+
+// a column of a batch, type is AURA_INT32, AURA_FLOAT32 or AURA_FLOAT64
+struct aura_column {
+	void *ptr;
+	int type;
+};
+
+// Run a word for each row of the input columns, returns the number of rows run in lock-step
+int aura_runbatch(struct aura_context *ctx, const char *word, const struct aura_column *in, int nin, const struct aura_column *out, int nout, int rows);
+
+// keys of aura_profreport
+#define AURA_PROFCALLS 0
+#define AURA_PROFSELF 1
+#define AURA_PROFTOTAL 2
+#define AURA_PROFALLOC 3
+
+// ticks are cpu cycles on x86, nanoseconds elsewhere ; alloc is the list slots
+struct aura_profentry {
+	const char *name;
+	unsigned calls;
+	unsigned long long self;
+	unsigned long long total;
+	unsigned long long alloc;
+};
+
+// Start (and reset) or stop profiling the word calls, returns 0 if aura.c is compiled without AURA_PROFILE
+int aura_profile(struct aura_context *ctx, int enable);
+// Fill at most n entries sorted by the key (descending), returns the number of the words called
+int aura_profreport(struct aura_context *ctx, struct aura_profentry *e, int n, int key);
+// Folded stacks ("a;b;c self" lines) of the flame graph tools, returns the size as snprintf does
+int aura_profflame(struct aura_context *ctx, char *buf, int sz);
 
 #endif
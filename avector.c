@@ -0,0 +1,400 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "avector.h"
+
+/*
+	The kernels are written once with the vector extension of gcc/clang and instantiated
+	for 128bits vectors (SSE2 or NEON, always available) and 256bits vectors with AVX2 on x86.
+	The tails (n not a multiple of the lanes) are done by the scalar loops.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VECTOR_AVX2
+#endif
+
+typedef float vf128 __attribute__((vector_size(16)));
+typedef int32_t vi128 __attribute__((vector_size(16)));
+typedef uint32_t vu128 __attribute__((vector_size(16)));
+
+#define LOAD(v, p) memcpy(&(v), (p), sizeof(v))
+#define STORE(p, v) memcpy((p), &(v), sizeof(v))
+#define LOOP(L, body) for (; i + (L) <= n; i += (L)) { body }
+
+static void
+binf_tail(int op, const float *a, const float *b, void *out, int i, int n) {
+	float *r = (float *)out;
+	int32_t *m = (int32_t *)out;
+	for (; i < n; i++) {
+		switch (op) {
+		case AURA_VADD: r[i] = a[i] + b[i]; break;
+		case AURA_VSUB: r[i] = a[i] - b[i]; break;
+		case AURA_VMUL: r[i] = a[i] * b[i]; break;
+		case AURA_VDIV: r[i] = a[i] / b[i]; break;
+		case AURA_VLT: m[i] = a[i] < b[i]; break;
+		case AURA_VGT: m[i] = a[i] > b[i]; break;
+		case AURA_VLE: m[i] = a[i] <= b[i]; break;
+		case AURA_VGE: m[i] = a[i] >= b[i]; break;
+		case AURA_VEQ: m[i] = a[i] == b[i]; break;
+		}
+	}
+}
+
+// integer arithmetic wraps around as the scripts do
+static void
+bini_tail(int op, const int32_t *a, const int32_t *b, int32_t *r, int i, int n) {
+	for (; i < n; i++) {
+		switch (op) {
+		case AURA_VADD: r[i] = (int32_t)((uint32_t)a[i] + (uint32_t)b[i]); break;
+		case AURA_VSUB: r[i] = (int32_t)((uint32_t)a[i] - (uint32_t)b[i]); break;
+		case AURA_VMUL: r[i] = (int32_t)((uint32_t)a[i] * (uint32_t)b[i]); break;
+		case AURA_VDIV: r[i] = a[i] / b[i]; break;
+		case AURA_VLT: r[i] = a[i] < b[i]; break;
+		case AURA_VGT: r[i] = a[i] > b[i]; break;
+		case AURA_VLE: r[i] = a[i] <= b[i]; break;
+		case AURA_VGE: r[i] = a[i] >= b[i]; break;
+		case AURA_VEQ: r[i] = a[i] == b[i]; break;
+		}
+	}
+}
+
+static float
+reducef_tail(int op, const float *a, const float *b, int i, int n, float r) {
+	for (; i < n; i++) {
+		switch (op) {
+		case AURA_VSUM: r += a[i]; break;
+		case AURA_VMIN: if (a[i] < r) r = a[i]; break;
+		case AURA_VMAX: if (a[i] > r) r = a[i]; break;
+		case AURA_VDOT: r += a[i] * b[i]; break;
+		}
+	}
+	return r;
+}
+
+static int32_t
+reducei_tail(int op, const int32_t *a, const int32_t *b, int i, int n, int32_t r) {
+	for (; i < n; i++) {
+		switch (op) {
+		case AURA_VSUM: r = (int32_t)((uint32_t)r + (uint32_t)a[i]); break;
+		case AURA_VMIN: if (a[i] < r) r = a[i]; break;
+		case AURA_VMAX: if (a[i] > r) r = a[i]; break;
+		case AURA_VDOT: r = (int32_t)((uint32_t)r + (uint32_t)a[i] * (uint32_t)b[i]); break;
+		}
+	}
+	return r;
+}
+
+#define KERNELS(S, ATTR, VF, VI, VU, L) \
+ATTR static void \
+binf_##S(int op, const float *a, const float *b, void *out, int n) { \
+	float *r = (float *)out; \
+	int32_t *m = (int32_t *)out; \
+	int i = 0; \
+	VF x, y; \
+	VI c; \
+	switch (op) { \
+	case AURA_VADD: LOOP(L, LOAD(x, a+i); LOAD(y, b+i); x += y; STORE(r+i, x);) break; \
+	case AURA_VSUB: LOOP(L, LOAD(x, a+i); LOAD(y, b+i); x -= y; STORE(r+i, x);) break; \
+	case AURA_VMUL: LOOP(L, LOAD(x, a+i); LOAD(y, b+i); x *= y; STORE(r+i, x);) break; \
+	case AURA_VDIV: LOOP(L, LOAD(x, a+i); LOAD(y, b+i); x /= y; STORE(r+i, x);) break; \
+	case AURA_VLT: LOOP(L, LOAD(x, a+i); LOAD(y, b+i); c = (x < y) & 1; STORE(m+i, c);) break; \
+	case AURA_VGT: LOOP(L, LOAD(x, a+i); LOAD(y, b+i); c = (x > y) & 1; STORE(m+i, c);) break; \
+	case AURA_VLE: LOOP(L, LOAD(x, a+i); LOAD(y, b+i); c = (x <= y) & 1; STORE(m+i, c);) break; \
+	case AURA_VGE: LOOP(L, LOAD(x, a+i); LOAD(y, b+i); c = (x >= y) & 1; STORE(m+i, c);) break; \
+	case AURA_VEQ: LOOP(L, LOAD(x, a+i); LOAD(y, b+i); c = (x == y) & 1; STORE(m+i, c);) break; \
+	} \
+	binf_tail(op, a, b, out, i, n); \
+} \
+ATTR static void \
+bini_##S(int op, const int32_t *a, const int32_t *b, int32_t *r, int n) { \
+	int i = 0; \
+	VU x, y; \
+	VI c, sx, sy; \
+	switch (op) { \
+	case AURA_VADD: LOOP(L, LOAD(x, a+i); LOAD(y, b+i); x += y; STORE(r+i, x);) break; \
+	case AURA_VSUB: LOOP(L, LOAD(x, a+i); LOAD(y, b+i); x -= y; STORE(r+i, x);) break; \
+	case AURA_VMUL: LOOP(L, LOAD(x, a+i); LOAD(y, b+i); x *= y; STORE(r+i, x);) break; \
+	case AURA_VLT: LOOP(L, LOAD(sx, a+i); LOAD(sy, b+i); c = (sx < sy) & 1; STORE(r+i, c);) break; \
+	case AURA_VGT: LOOP(L, LOAD(sx, a+i); LOAD(sy, b+i); c = (sx > sy) & 1; STORE(r+i, c);) break; \
+	case AURA_VLE: LOOP(L, LOAD(sx, a+i); LOAD(sy, b+i); c = (sx <= sy) & 1; STORE(r+i, c);) break; \
+	case AURA_VGE: LOOP(L, LOAD(sx, a+i); LOAD(sy, b+i); c = (sx >= sy) & 1; STORE(r+i, c);) break; \
+	case AURA_VEQ: LOOP(L, LOAD(sx, a+i); LOAD(sy, b+i); c = (sx == sy) & 1; STORE(r+i, c);) break; \
+	} \
+	bini_tail(op, a, b, r, i, n); \
+} \
+ATTR static float \
+reducef_##S(int op, const float *a, const float *b, int n) { \
+	int i = 0, j; \
+	VF x, y, acc = { 0 }; \
+	VI mk; \
+	float r = 0; \
+	switch (op) { \
+	case AURA_VSUM: \
+		LOOP(L, LOAD(x, a+i); acc += x;) \
+		for (j=0;j<L;j++) r += acc[j]; \
+		break; \
+	case AURA_VDOT: \
+		LOOP(L, LOAD(x, a+i); LOAD(y, b+i); acc += x * y;) \
+		for (j=0;j<L;j++) r += acc[j]; \
+		break; \
+	case AURA_VMIN: \
+	case AURA_VMAX: \
+		r = a[0]; \
+		if (n < L) \
+			break; \
+		LOAD(acc, a); \
+		i = L; \
+		if (op == AURA_VMIN) { \
+			LOOP(L, LOAD(x, a+i); mk = x < acc; acc = (VF)(((VI)x & mk) | ((VI)acc & ~mk));) \
+		} else { \
+			LOOP(L, LOAD(x, a+i); mk = x > acc; acc = (VF)(((VI)x & mk) | ((VI)acc & ~mk));) \
+		} \
+		for (j=0;j<L;j++) { \
+			if (op == AURA_VMIN ? acc[j] < r : acc[j] > r) \
+				r = acc[j]; \
+		} \
+		break; \
+	} \
+	return reducef_tail(op, a, b, i, n, r); \
+} \
+ATTR static int32_t \
+reducei_##S(int op, const int32_t *a, const int32_t *b, int n) { \
+	int i = 0, j; \
+	VU x, y, acc = { 0 }; \
+	VI sx, sacc, mk; \
+	int32_t r = 0; \
+	switch (op) { \
+	case AURA_VSUM: \
+		LOOP(L, LOAD(x, a+i); acc += x;) \
+		for (j=0;j<L;j++) r = (int32_t)((uint32_t)r + acc[j]); \
+		break; \
+	case AURA_VDOT: \
+		LOOP(L, LOAD(x, a+i); LOAD(y, b+i); acc += x * y;) \
+		for (j=0;j<L;j++) r = (int32_t)((uint32_t)r + acc[j]); \
+		break; \
+	case AURA_VMIN: \
+	case AURA_VMAX: \
+		r = a[0]; \
+		if (n < L) \
+			break; \
+		LOAD(sacc, a); \
+		i = L; \
+		if (op == AURA_VMIN) { \
+			LOOP(L, LOAD(sx, a+i); mk = sx < sacc; sacc = (sx & mk) | (sacc & ~mk);) \
+		} else { \
+			LOOP(L, LOAD(sx, a+i); mk = sx > sacc; sacc = (sx & mk) | (sacc & ~mk);) \
+		} \
+		for (j=0;j<L;j++) { \
+			if (op == AURA_VMIN ? sacc[j] < r : sacc[j] > r) \
+				r = sacc[j]; \
+		} \
+		break; \
+	} \
+	return reducei_tail(op, a, b, i, n, r); \
+} \
+ATTR static void \
+axpyf_##S(float a, const float *x, float *y, int n) { \
+	int i = 0; \
+	VF vx, vy; \
+	LOOP(L, LOAD(vx, x+i); LOAD(vy, y+i); vy += vx * a; STORE(y+i, vy);) \
+	for (; i < n; i++) \
+		y[i] += a * x[i]; \
+} \
+ATTR static void \
+axpyi_##S(int32_t a, const int32_t *x, int32_t *y, int n) { \
+	int i = 0; \
+	VU vx, vy; \
+	LOOP(L, LOAD(vx, x+i); LOAD(vy, y+i); vy += vx * (uint32_t)a; STORE(y+i, vy);) \
+	for (; i < n; i++) \
+		y[i] = (int32_t)((uint32_t)y[i] + (uint32_t)a * (uint32_t)x[i]); \
+}
+
+KERNELS(128, , vf128, vi128, vu128, 4)
+
+#ifdef VECTOR_AVX2
+
+typedef float vf256 __attribute__((vector_size(32)));
+typedef int32_t vi256 __attribute__((vector_size(32)));
+typedef uint32_t vu256 __attribute__((vector_size(32)));
+
+KERNELS(256, __attribute__((target("avx2"))), vf256, vi256, vu256, 8)
+
+#endif
+
+// 1 : 128bits, 2 : avx2
+static int
+vector_isa(void) {
+	static int isa = 0;
+	if (isa == 0) {
+#ifdef VECTOR_AVX2
+		__builtin_cpu_init();
+		isa = __builtin_cpu_supports("avx2") ? 2 : 1;
+#else
+		isa = 1;
+#endif
+	}
+	return isa;
+}
+
+#ifdef VECTOR_AVX2
+#define DISPATCH(f, ...) (vector_isa() == 2 ? f##_256(__VA_ARGS__) : f##_128(__VA_ARGS__))
+#else
+#define DISPATCH(f, ...) f##_128(__VA_ARGS__)
+#endif
+
+const char *
+auraV_isa(void) {
+	return vector_isa() == 2 ? "avx2" : "128";
+}
+
+int
+auraV_binf(int op, const float *a, const float *b, void *r, int n) {
+	int i;
+	if (op == AURA_VDIV) {
+		for (i=0;i<n;i++) {
+			if (b[i] == 0)
+				return 0;
+		}
+	}
+	DISPATCH(binf, op, a, b, r, n);
+	return 1;
+}
+
+int
+auraV_bini(int op, const int32_t *a, const int32_t *b, int32_t *r, int n) {
+	if (op == AURA_VDIV) {
+		// no integer division in the vector units
+		int i;
+		for (i=0;i<n;i++) {
+			if (b[i] == 0)
+				return 0;
+		}
+		bini_tail(op, a, b, r, 0, n);
+		return 1;
+	}
+	DISPATCH(bini, op, a, b, r, n);
+	return 1;
+}
+
+// The float sum and dot are computed in L partial sums, the rounding differs from a sequential loop
+float
+auraV_reducef(int op, const float *a, const float *b, int n) {
+	if (n == 0)
+		return 0;
+	return DISPATCH(reducef, op, a, b, n);
+}
+
+int32_t
+auraV_reducei(int op, const int32_t *a, const int32_t *b, int n) {
+	if (n == 0)
+		return 0;
+	return DISPATCH(reducei, op, a, b, n);
+}
+
+void
+auraV_axpyf(float a, const float *x, float *y, int n) {
+	DISPATCH(axpyf, a, x, y, n);
+}
+
+void
+auraV_axpyi(int32_t a, const int32_t *x, int32_t *y, int n) {
+	DISPATCH(axpyi, a, x, y, n);
+}
+
+void
+auraV_radixsort(uint32_t *key, uint32_t *idx, uint32_t *tmp, int n) {
+	int count[4][256];
+	memset(count, 0, sizeof(count));
+	int i, pass;
+	for (i=0;i<n;i++) {
+		uint32_t k = key[i];
+		++count[0][k & 0xff];
+		++count[1][(k >> 8) & 0xff];
+		++count[2][(k >> 16) & 0xff];
+		++count[3][k >> 24];
+	}
+	uint32_t *k0 = key, *k1 = tmp;
+	uint32_t *i0 = idx, *i1 = tmp + n;
+	for (pass=0;pass<4;pass++) {
+		int shift = pass * 8;
+		int *c = count[pass];
+		if (n > 0 && c[(key[0] >> shift) & 0xff] == n)
+			continue;	// all the keys share this byte
+		int sum = 0;
+		for (i=0;i<256;i++) {
+			int t = c[i];
+			c[i] = sum;
+			sum += t;
+		}
+		for (i=0;i<n;i++) {
+			int pos = c[(k0[i] >> shift) & 0xff]++;
+			k1[pos] = k0[i];
+			if (idx)
+				i1[pos] = i0[i];
+		}
+		uint32_t *t = k0; k0 = k1; k1 = t;
+		t = i0; i0 = i1; i1 = t;
+	}
+	if (k0 != key) {
+		memcpy(key, k0, n * sizeof(uint32_t));
+		if (idx)
+			memcpy(idx, i0, n * sizeof(uint32_t));
+	}
+}
+
+#ifdef VECTOR_TESTMAIN
+
+#include <stdio.h>
+#include <assert.h>
+
+int
+main() {
+	float a[37], b[37], r[37];
+	int32_t ia[37], ib[37], ir[37];
+	int i;
+	for (i=0;i<37;i++) {
+		a[i] = (float)i;
+		b[i] = (float)(37 - i);
+		ia[i] = i - 18;
+		ib[i] = 2;
+	}
+	auraV_binf(AURA_VADD, a + 1, b + 1, r + 1, 36);	// unaligned
+	for (i=1;i<37;i++)
+		assert(r[i] == 37);
+	auraV_binf(AURA_VLT, a, b, ir, 37);
+	for (i=0;i<37;i++)
+		assert(ir[i] == (a[i] < b[i]));
+	assert(auraV_reducef(AURA_VSUM, a, NULL, 37) == 666);
+	assert(auraV_reducef(AURA_VMAX, a, NULL, 37) == 36);
+	assert(auraV_reducef(AURA_VMIN, b, NULL, 37) == 1);
+	assert(auraV_reducef(AURA_VDOT, a, a, 37) == 16206);
+	auraV_bini(AURA_VMUL, ia, ib, ir, 37);
+	for (i=0;i<37;i++)
+		assert(ir[i] == ia[i] * 2);
+	assert(auraV_bini(AURA_VDIV, ia, ib, ir, 37) && ir[0] == -9);
+	ib[30] = 0;
+	assert(!auraV_bini(AURA_VDIV, ia, ib, ir, 37));
+	assert(auraV_reducei(AURA_VSUM, ia, NULL, 37) == 0);
+	assert(auraV_reducei(AURA_VMIN, ia, NULL, 37) == -18);
+	assert(auraV_reducei(AURA_VMAX, ia, NULL, 37) == 18);
+	auraV_axpyf(2, a, r, 37);
+	assert(r[36] == 37 + 72);
+	auraV_axpyi(3, ia, ir, 37);
+	uint32_t key[37], idx[37], tmp[74];
+	for (i=0;i<37;i++) {
+		key[i] = auraV_keyf((float)((i * 7919) % 37) - 18.5f);
+		idx[i] = i;
+	}
+	auraV_radixsort(key, idx, tmp, 37);
+	for (i=1;i<37;i++)
+		assert(auraV_fromkeyf(key[i-1]) < auraV_fromkeyf(key[i]));
+	assert(auraV_fromkeyf(key[0]) == -18.5f && idx[0] == 0);
+	for (i=0;i<37;i++)
+		key[i] = auraV_keyi(ia[36 - i]);
+	auraV_radixsort(key, NULL, tmp, 37);
+	assert(auraV_fromkeyi(key[0]) == -18 && auraV_fromkeyi(key[36]) == 18);
+	printf("vector %s ok\n", auraV_isa());
+	return 0;
+}
+
+#endif
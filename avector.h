@@ -0,0 +1,70 @@
+#ifndef aura_vector_h
+#define aura_vector_h
+
+#include <stdint.h>
+#include <string.h>
+
+// element-wise
+#define AURA_VADD 0
+#define AURA_VSUB 1
+#define AURA_VMUL 2
+#define AURA_VDIV 3
+// comparisons, the result is 0 or 1 (int32)
+#define AURA_VLT 4
+#define AURA_VGT 5
+#define AURA_VLE 6
+#define AURA_VGE 7
+#define AURA_VEQ 8
+// reductions
+#define AURA_VSUM 9
+#define AURA_VMIN 10
+#define AURA_VMAX 11
+#define AURA_VDOT 12
+
+/*
+	Kernels over arrays of n elements, the pointers don't need to be aligned.
+	The widest instruction set of the cpu is chosen at the first call.
+	r is int32_t * for the comparisons. Division by zero returns 0 and writes nothing, 1 otherwise.
+ */
+int auraV_binf(int op, const float *a, const float *b, void *r, int n);
+int auraV_bini(int op, const int32_t *a, const int32_t *b, int32_t *r, int n);
+float auraV_reducef(int op, const float *a, const float *b, int n);
+int32_t auraV_reducei(int op, const int32_t *a, const int32_t *b, int n);
+// y = a * x + y
+void auraV_axpyf(float a, const float *x, float *y, int n);
+void auraV_axpyi(int32_t a, const int32_t *x, int32_t *y, int n);
+const char * auraV_isa(void);
+
+/*
+	Stable LSD radix sort of uint32 keys, idx (may be NULL) is permuted with the keys.
+	tmp is 2 * n words.
+ */
+void auraV_radixsort(uint32_t *key, uint32_t *idx, uint32_t *tmp, int n);
+
+// Keys of the radix sort, in the order of the numbers
+static inline uint32_t
+auraV_keyi(int32_t v) {
+	return (uint32_t)v ^ 0x80000000u;
+}
+
+static inline int32_t
+auraV_fromkeyi(uint32_t k) {
+	return (int32_t)(k ^ 0x80000000u);
+}
+
+static inline uint32_t
+auraV_keyf(float v) {
+	uint32_t u;
+	memcpy(&u, &v, sizeof(u));
+	return (u & 0x80000000u) ? ~u : u | 0x80000000u;
+}
+
+static inline float
+auraV_fromkeyf(uint32_t k) {
+	uint32_t u = (k & 0x80000000u) ? k & 0x7fffffffu : ~k;
+	float v;
+	memcpy(&v, &u, sizeof(v));
+	return v;
+}
+
+#endif
@@ -34,6 +34,8 @@ insert_word(struct aura_wordlist *words, int index, uint32_t h, const char *name
 	memmove(&words->index[index+1],&words->index[index], (word_index - index) * sizeof(*words->index));
 	words->index[index] = word_index;
 	w->func = NULL;
+	w->version = 0;
+	w->inlined = 0;
 }
 
 #include <stdio.h>
@@ -87,6 +89,7 @@ auraW_register(struct aura_wordlist *words, const char *name, aura_cfunction fun
 	struct aura_word *w = &words->w[index];
 	w->func = func;
 	w->u.ud = ud;
+	++w->version;
 	return index;
 }
 
@@ -12,6 +12,8 @@
 
 struct aura_word {
 	aura_cfunction func;
+	uint32_t version;	// bumped when the word is rebound
+	int inlined;	// compiled code depends on the binding (inlined or folded)
 	union {
 		void * ud;
 		int id[2];